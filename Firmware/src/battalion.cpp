@@ -0,0 +1,221 @@
+/*
+ * battalion.cpp
+ *
+ * See battalion.h.
+ */
+
+#include "battalion.h"
+
+#ifdef SUPPORTBATTALION
+#include <string.h>
+#include <avr/pgmspace.h>
+
+//Layer code of an SBC_GAMEPAD_W<word>_<name> button
+static constexpr uint8_t maskBit(uint16_t mask)
+{
+    return mask <= 1 ? 0 : 1 + maskBit(mask >> 1);
+}
+#define SB_W0(name) (uint8_t)(0x00 | maskBit(SBC_GAMEPAD_W0_##name))
+#define SB_W1(name) (uint8_t)(0x10 | maskBit(SBC_GAMEPAD_W1_##name))
+#define SB_W2(name) (uint8_t)(0x20 | maskBit(SBC_GAMEPAD_W2_##name))
+
+//Indexed by IN_* bit number: DUP, DDOWN, DLEFT, DRIGHT, START, BACK, LS, RS, A, B, X, Y, WHITE (LB), BLACK (RB), XBOX
+#define BATTALION_PAD_BUTTONS 16
+static const uint8_t BATTALION_PAD[BATTALION_PAD_BUTTONS] PROGMEM = {
+    BATTALION_GEAR_UP, BATTALION_GEAR_DOWN, BATTALION_TUNER_DOWN, BATTALION_TUNER_UP,
+    SB_W0(START), SB_W0(IGNITION), BATTALION_SLIDE, SB_W2(LEFTJOYSIGHTCHANGE),
+    SB_W0(RIGHTJOYFIRE), SB_W0(RIGHTJOYLOCKON), SB_W1(WEAPONCONMAGAZINE), SB_W1(WEAPONCONMAIN),
+    BATTALION_NONE, SB_W0(RIGHTJOYMAINWEAPON), BATTALION_NONE, BATTALION_NONE};
+
+//While BATTALION_SHIFT is held
+static const uint8_t BATTALION_PAD_SHIFTED[BATTALION_PAD_BUTTONS] PROGMEM = {
+    SB_W0(MULTIMONOPENCLOSE), SB_W0(MULTIMONMODESELECT), SB_W0(MULTIMONMAPZOOMINOUT), SB_W0(MULTIMONSUBMONITOR),
+    SB_W0(COCKPITHATCH), BATTALION_TOGGLES, SB_W0(MAINMONZOOMOUT), SB_W1(FUNCTIONNIGHTSCOPE),
+    SB_W1(CHAFF), SB_W1(EXTINGUISHER), SB_W1(WASHING), SB_W1(WEAPONCONSUB),
+    BATTALION_NONE, SB_W0(MAINMONZOOMIN), BATTALION_NONE, BATTALION_NONE};
+
+static void battalionPress(uint16_t *buttons, uint8_t code)
+{
+    buttons[code >> 4] |= 1u << (code & 0x0F);
+}
+
+void battalionReset(Battalion_t *sb)
+{
+    sb->held = 0;
+    sb->gear = BATTALION_GEAR_N;
+    sb->tuner = 0;
+    sb->toggles = 0;
+}
+
+//Build the report from the pad and, if keys is not NULL, the keyboard. Returns true if the report changed.
+bool battalionMap(Battalion_t *sb, const InputSnapshot_t *in, const BattalionKeys_t *keys, USB_XboxSteelBattalion_Data_t *report)
+{
+    USB_XboxSteelBattalion_Data_t out;
+    memset(&out, 0x00, sizeof(out));
+    out.bLength = BATTALION_REPORT_SIZE;
+
+    bool shifted = in->buttons & BATTALION_SHIFT;
+    const uint8_t *layer = shifted ? BATTALION_PAD_SHIFTED : BATTALION_PAD;
+    uint16_t held = in->buttons;
+    uint16_t pressed = held & ~sb->held;
+    sb->held = held;
+
+    //Only the buttons held are looked up
+    for (uint8_t i = 0; held; i++, held >>= 1, pressed >>= 1)
+    {
+        if (!(held & 1))
+            continue;
+        uint8_t code = pgm_read_byte(&layer[i]);
+        if (code < BATTALION_ACTION)
+            battalionPress(out.dButtons, code);
+        else if (code == BATTALION_SLIDE)
+            out.leftPedal = 0xFFFF;
+        else if (pressed & 1)
+        {
+            switch (code)
+            {
+            case BATTALION_GEAR_UP:
+                if (sb->gear < BATTALION_GEAR_5)
+                    sb->gear++;
+                break;
+            case BATTALION_GEAR_DOWN:
+                if (sb->gear > BATTALION_GEAR_R)
+                    sb->gear--;
+                break;
+            case BATTALION_TUNER_UP:
+                if (sb->tuner < BATTALION_TUNER_MAX)
+                    sb->tuner++;
+                break;
+            case BATTALION_TUNER_DOWN:
+                if (sb->tuner > 0)
+                    sb->tuner--;
+                break;
+            case BATTALION_TOGGLES:
+                sb->toggles ^= BATTALION_TOGGLE_SWITCHES;
+                break;
+            }
+        }
+    }
+    out.dButtons[2] |= sb->toggles;
+    if (keys != NULL)
+    {
+        out.dButtons[0] |= keys->buttons[0];
+        out.dButtons[1] |= keys->buttons[1];
+        out.dButtons[2] |= keys->buttons[2];
+        out.dButtons[2] ^= keys->toggles;
+    }
+    out.gearLever = sb->gear;
+    out.tunerDial = sb->tuner;
+
+    //Right stick aims. Left stick turns, or moves the sight change stick while shifted, and looks up and down
+    out.aimingX = (uint16_t)in->rightStickX + 0x8000u;
+    out.aimingY = 0x7FFFu - (uint16_t)in->rightStickY;
+    if (shifted)
+        out.sightChangeX = in->leftStickX;
+    else
+        out.rotationLever = in->leftStickX;
+    out.sightChangeY = in->leftStickY;
+
+    //Accelerator and brake
+    out.rightPedal = in->rightTrigger * 0x0101u;
+    out.middlePedal = in->leftTrigger * 0x0101u;
+
+    if (memcmp(report, &out, sizeof(out)) == 0)
+        return false;
+    *report = out;
+    return true;
+}
+
+#ifdef ENABLE_BATTALION_KEYBOARD
+typedef struct
+{
+    uint8_t key;  //HID usage ID
+    uint8_t code; //Layer code, see battalion.h
+} BattalionKey_t;
+
+//The buttons that have no room on the pad. F5 to F9 flip the toggle switches one at a time
+static const BattalionKey_t BATTALION_KEYS[] PROGMEM = {
+    {HID_KEYBOARD_SC_ENTER, SB_W0(START)},
+    {HID_KEYBOARD_SC_I, SB_W0(IGNITION)},
+    {HID_KEYBOARD_SC_H, SB_W0(COCKPITHATCH)},
+    {HID_KEYBOARD_SC_DELETE, SB_W0(EJECT)},
+    {HID_KEYBOARD_SC_M, SB_W0(MULTIMONOPENCLOSE)},
+    {HID_KEYBOARD_SC_Z, SB_W0(MULTIMONMAPZOOMINOUT)},
+    {HID_KEYBOARD_SC_N, SB_W0(MULTIMONMODESELECT)},
+    {HID_KEYBOARD_SC_B, SB_W0(MULTIMONSUBMONITOR)},
+    {HID_KEYBOARD_SC_PAGE_UP, SB_W0(MAINMONZOOMIN)},
+    {HID_KEYBOARD_SC_PAGE_DOWN, SB_W0(MAINMONZOOMOUT)},
+    {HID_KEYBOARD_SC_F, SB_W0(FUNCTIONFSS)},
+    {HID_KEYBOARD_SC_G, SB_W0(FUNCTIONMANIPULATOR)},
+    {HID_KEYBOARD_SC_L, SB_W0(FUNCTIONLINECOLORCHANGE)},
+    {HID_KEYBOARD_SC_W, SB_W1(WASHING)},
+    {HID_KEYBOARD_SC_X, SB_W1(EXTINGUISHER)},
+    {HID_KEYBOARD_SC_C, SB_W1(CHAFF)},
+    {HID_KEYBOARD_SC_T, SB_W1(FUNCTIONTANKDETACH)},
+    {HID_KEYBOARD_SC_O, SB_W1(FUNCTIONOVERRIDE)},
+    {HID_KEYBOARD_SC_V, SB_W1(FUNCTIONNIGHTSCOPE)},
+    {HID_KEYBOARD_SC_F1, SB_W1(FUNCTIONF1)},
+    {HID_KEYBOARD_SC_F2, SB_W1(FUNCTIONF2)},
+    {HID_KEYBOARD_SC_F3, SB_W1(FUNCTIONF3)},
+    {HID_KEYBOARD_SC_TAB, SB_W1(WEAPONCONMAIN)},
+    {HID_KEYBOARD_SC_Q, SB_W1(WEAPONCONSUB)},
+    {HID_KEYBOARD_SC_R, SB_W1(WEAPONCONMAGAZINE)},
+    {HID_KEYBOARD_SC_1_AND_EXCLAMATION, SB_W1(COMM1)},
+    {HID_KEYBOARD_SC_2_AND_AT, SB_W1(COMM2)},
+    {HID_KEYBOARD_SC_3_AND_HASHMARK, SB_W1(COMM3)},
+    {HID_KEYBOARD_SC_4_AND_DOLLAR, SB_W1(COMM4)},
+    {HID_KEYBOARD_SC_5_AND_PERCENTAGE, SB_W2(COMM5)},
+    {HID_KEYBOARD_SC_S, SB_W2(LEFTJOYSIGHTCHANGE)},
+    {HID_KEYBOARD_SC_F5, SB_W2(TOGGLEFILTERCONTROL)},
+    {HID_KEYBOARD_SC_F6, SB_W2(TOGGLEOXYGENSUPPLY)},
+    {HID_KEYBOARD_SC_F7, SB_W2(TOGGLEFUELFLOWRATE)},
+    {HID_KEYBOARD_SC_F8, SB_W2(TOGGLEBUFFREMATERIAL)},
+    {HID_KEYBOARD_SC_F9, SB_W2(TOGGLEVTLOCATION)},
+};
+#define BATTALION_KEY_COUNT (sizeof(BATTALION_KEYS) / sizeof(BattalionKey_t))
+
+static uint8_t battalionKeyCode(uint8_t key)
+{
+    for (uint8_t i = 0; i < BATTALION_KEY_COUNT; i++)
+    {
+        if (pgm_read_byte(&BATTALION_KEYS[i].key) == key)
+            return pgm_read_byte(&BATTALION_KEYS[i].code);
+    }
+    return BATTALION_NONE;
+}
+
+//Boot protocol report: modifiers, reserved, then up to six keys held
+void BattalionKeyboard::Parse(USBHID *hid __attribute__((unused)), bool is_rpt_id __attribute__((unused)), uint8_t len, uint8_t *buf)
+{
+    if (len < 8 || buf[2] == HID_KEYBOARD_SC_ERROR_ROLLOVER)
+        return;
+
+    BattalionKeys_t next;
+    memset(&next, 0x00, sizeof(next));
+    next.toggles = state.toggles;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        uint8_t key = buf[i + 2];
+        uint8_t code = key ? battalionKeyCode(key) : BATTALION_NONE;
+        if (code >= BATTALION_ACTION)
+            continue;
+        uint16_t mask = 1u << (code & 0x0F);
+        if ((code >> 4) == 2 && (mask & BATTALION_TOGGLE_SWITCHES))
+        {
+            if (!memchr(prevKeys, key, sizeof(prevKeys)))
+                next.toggles ^= mask;
+        }
+        else
+            battalionPress(next.buttons, code);
+    }
+    memcpy(prevKeys, &buf[2], sizeof(prevKeys));
+
+    if (memcmp(&next, &state, sizeof(state)))
+    {
+        state = next;
+        seq++;
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * battalion.h
+ *
+ * Steel Battalion emulation from a standard pad. The Battalion has 39
+ * buttons, three pedals, a gear lever and a tuner dial, so every pad
+ * button is looked up in one of two PROGMEM layers of one byte per button,
+ * the second while LB is held. An optional boot protocol keyboard on a hub
+ * covers the buttons the pad has no room for. The report is only rebuilt
+ * when the input changes, sending it each frame is a copy like the Duke.
+ */
+
+#ifndef BATTALION_H_
+#define BATTALION_H_
+#include "settings.h"
+
+#ifdef SUPPORTBATTALION
+#include "inputsnapshot.h"
+#include "steelbattalion.h"
+
+//A layer entry is a button, (word << 4) | bit in dButtons[word], or one of these actions
+#define BATTALION_ACTION 0xF0 //First action code
+#define BATTALION_NONE 0xF0
+#define BATTALION_GEAR_UP 0xF1
+#define BATTALION_GEAR_DOWN 0xF2
+#define BATTALION_TUNER_UP 0xF3
+#define BATTALION_TUNER_DOWN 0xF4
+#define BATTALION_SLIDE 0xF5   //Left pedal fully down while held
+#define BATTALION_TOGGLES 0xF6 //Flips the five toggle switches of the start up sequence
+
+#define BATTALION_SHIFT IN_WHITE //Selects the second layer while held
+
+#define BATTALION_GEAR_R 7 //gearLever values, N is 8 and 1st to 5th are 9 to 13
+#define BATTALION_GEAR_N 8
+#define BATTALION_GEAR_5 13
+#define BATTALION_TUNER_MAX 15
+
+#define BATTALION_TOGGLE_SWITCHES (SBC_GAMEPAD_W2_TOGGLEFILTERCONTROL | SBC_GAMEPAD_W2_TOGGLEOXYGENSUPPLY |  \
+                                   SBC_GAMEPAD_W2_TOGGLEFUELFLOWRATE | SBC_GAMEPAD_W2_TOGGLEBUFFREMATERIAL | \
+                                   SBC_GAMEPAD_W2_TOGGLEVTLOCATION)
+
+typedef struct
+{
+    uint16_t held;    //IN_* bits at the last battalionMap(), to find new presses
+    int8_t gear;      //BATTALION_GEAR_R to BATTALION_GEAR_5
+    int8_t tuner;     //0 to BATTALION_TUNER_MAX
+    uint16_t toggles; //Toggle switches that are up, SBC_GAMEPAD_W2_* bits
+} Battalion_t;
+
+//Buttons from the keyboard, merged into the report by battalionMap()
+typedef struct
+{
+    uint16_t buttons[3]; //dButtons bits of the keys held
+    uint16_t toggles;    //Toggle switches flipped from the keyboard
+} BattalionKeys_t;
+
+void battalionReset(Battalion_t *sb);
+bool battalionMap(Battalion_t *sb, const InputSnapshot_t *in, const BattalionKeys_t *keys, USB_XboxSteelBattalion_Data_t *report);
+
+#ifdef ENABLE_BATTALION_KEYBOARD
+#include <hidboot.h>
+
+//Collects the Battalion buttons of the keys held on a boot protocol keyboard, see BATTALION_KEYS[]
+class BattalionKeyboard : public HIDReportParser
+{
+public:
+    void Parse(USBHID *hid, bool is_rpt_id, uint8_t len, uint8_t *buf);
+    const BattalionKeys_t *keys() { return &state; }
+    uint16_t changes() { return seq; } //Counts changes to keys()
+
+private:
+    BattalionKeys_t state = {};
+    uint8_t prevKeys[6] = {};
+    uint16_t seq = 0;
+};
+#endif
+
+#endif
+#endif /* BATTALION_H_ */
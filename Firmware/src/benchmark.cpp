@@ -0,0 +1,236 @@
+/*
+ * benchmark.cpp
+ *
+ * Timing of the motion aiming maths, the original float version against
+ * the fixed point one in fixedmath.h and main.cpp, and of the Duke report
+ * path, the HID task as it was set up before xiddriver.c against what the
+ * main loop does now, for a changed and for an unchanged report. Build the BENCH
+ * environment (pio run -e BENCH -t upload) and read the results from
+ * Serial1 at 115200 baud. Each line is the average time of one call in
+ * microseconds and in CPU cycles.
+ *
+ * Flash cost is best compared with "pio run -e MSTR -t size" before and
+ * after, as the benchmark itself links both versions.
+ */
+
+#include "settings.h"
+
+#ifdef ENABLE_BENCHMARK
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+#include <fixedmath.h>
+#include "xiddevice.h"
+
+#define BENCHMARK_LOOPS 1000
+
+#ifdef ENABLE_MOTION
+int16_t applyMotion(int16_t stick, uint16_t angle);
+#endif
+bool xidReportDue(USB_ClassInfo_HID_Device_State_t *state, uint16_t frame, uint8_t interval);
+extern bool dukeReportDirty;
+
+//Accelerometer readings spread over all four quadrants, read through volatile so nothing is folded away
+volatile int16_t benchY[8] = {0, 120, -340, 511, -511, 77, 250, -20};
+volatile int16_t benchX[8] = {511, -200, 100, 0, -90, -400, 300, -511};
+volatile int32_t benchSink;
+
+//The implementation this replaces, kept here for comparison
+static float floatAngle(int16_t y, int16_t x)
+{
+    return (atan2f(y, x) + PI) * RAD_TO_DEG;
+}
+
+static int16_t floatMotion(int16_t stick, uint16_t angle, int8_t sensitivityAngle)
+{
+    int32_t clamped = angle;
+    if (clamped > 180 + sensitivityAngle) clamped = 180 + sensitivityAngle;
+    if (clamped < 180 - sensitivityAngle) clamped = 180 - sensitivityAngle;
+    float adjust = (float)(clamped - 180) / sensitivityAngle;
+    int32_t total = stick + (adjust * 32767);
+    if (total > 32767) total = 32767;
+    if (total < -32767) total = -32767;
+    return total;
+}
+
+static void report(const __FlashStringHelper *name, uint32_t elapsed)
+{
+    uint32_t cycles = elapsed * (F_CPU / 1000000UL) / BENCHMARK_LOOPS;
+    Serial1.print(name);
+    Serial1.print(elapsed / BENCHMARK_LOOPS);
+    Serial1.print(F(" us, "));
+    Serial1.print(cycles);
+    Serial1.println(F(" cycles"));
+}
+
+//HID_Device_USBTask() with the Duke interface as it was before xiddriver.c: the report is built
+//from XboxOGDuke into a VLA, compared with a copy of the last one and only sent if it changed or
+//the idle period is up. Kept here for comparison, with its own state so the real interface isn't touched
+static USB_XboxGamepad_Data_t baselinePrevReport;
+static uint16_t baselinePrevSize = sizeof(baselinePrevReport); //Not const, LUFA sizes the VLA at run time
+static USB_ClassInfo_HID_Device_State_t baselineState;
+
+static void baselineDukeTask()
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+    if (baselineState.PrevFrameNum == USB_Device_GetFrameNumber())
+        return;
+
+    Endpoint_SelectEndpoint(DUKE_IN_ENDPOINT);
+    if (Endpoint_IsReadWriteAllowed())
+    {
+        uint8_t reportData[baselinePrevSize];
+        memset(reportData, 0, sizeof(reportData));
+
+        //The report callback, which returned false so a report only went out when it changed
+        USB_XboxGamepad_Data_t *report = (USB_XboxGamepad_Data_t *)reportData;
+        report->startByte = 0x00;
+        report->bLength = DUKE_REPORT_SIZE;
+        report->dButtons = XboxOGDuke.dButtons;
+        report->reserved = 0x00;
+        report->A = XboxOGDuke.A;
+        report->B = XboxOGDuke.B;
+        report->X = XboxOGDuke.X;
+        report->Y = XboxOGDuke.Y;
+        report->BLACK = XboxOGDuke.BLACK;
+        report->WHITE = XboxOGDuke.WHITE;
+        report->L = XboxOGDuke.L;
+        report->R = XboxOGDuke.R;
+        report->leftStickX = XboxOGDuke.leftStickX;
+        report->leftStickY = XboxOGDuke.leftStickY;
+        report->rightStickX = XboxOGDuke.rightStickX;
+        report->rightStickY = XboxOGDuke.rightStickY;
+        uint16_t reportSize = report->bLength;
+
+        bool statesChanged = memcmp(reportData, &baselinePrevReport, reportSize) != 0;
+        memcpy(&baselinePrevReport, reportData, baselinePrevSize);
+        bool idleElapsed = baselineState.IdleCount && !baselineState.IdleMSRemaining;
+        if (reportSize && (statesChanged || idleElapsed))
+        {
+            baselineState.IdleMSRemaining = baselineState.IdleCount;
+            Endpoint_SelectEndpoint(DUKE_IN_ENDPOINT);
+            Endpoint_Write_Stream_LE(reportData, reportSize, NULL);
+            Endpoint_ClearIN();
+        }
+        baselineState.PrevFrameNum = USB_Device_GetFrameNumber();
+    }
+}
+
+//Empty the Duke IN endpoint again, so every load in a loop has a free bank to go to
+static void dropDukeIN()
+{
+    uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(DUKE_IN_ENDPOINT);
+    while (Endpoint_GetBusyBanks() != 0)
+    {
+        UEINTX |= (1 << KILLBK);
+        while (UEINTX & (1 << KILLBK))
+            ;
+    }
+    Endpoint_SelectEndpoint(prevEndpoint);
+}
+
+//Both paths send at most once a frame, so every call is made to look like the first of a new frame.
+//The endpoint only exists once a console or PC has configured the adapter
+static void benchmarkDukeReport()
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+    {
+        Serial1.println(F("Duke report: USB not configured"));
+        return;
+    }
+
+    USB_XboxGamepad_Data_t savedDuke = XboxOGDuke;
+    bool savedDirty = dukeReportDirty;
+    USB_ClassInfo_HID_Device_State_t *state = &DukeController_HID_Interface.State;
+    baselineState.IdleCount = state->IdleCount;
+    uint32_t start;
+
+    //A changed report, built, compared and sent
+    start = micros();
+    for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+    {
+        XboxOGDuke.leftStickX = i;
+        baselineState.PrevFrameNum = 0xFFFF; //Never a frame number
+        baselineDukeTask();
+        dropDukeIN();
+    }
+    report(F("Changed, before: "), micros() - start);
+
+    start = micros();
+    for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+    {
+        XboxOGDuke.leftStickX = i;
+        dukeReportDirty = true;
+        state->PrevFrameNum = 0xFFFF;
+        if (xidReportDue(state, 0, DUKE_POLL_INTERVAL_MS))
+        {
+            DukePublishInput(&XboxOGDuke);
+            DukeSendReport();
+        }
+        dropDukeIN();
+    }
+    report(F("Changed, now:    "), micros() - start);
+
+    //An unchanged report. Before, it was still built and compared every time
+    start = micros();
+    for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+    {
+        baselineState.PrevFrameNum = 0xFFFF;
+        baselineDukeTask();
+    }
+    report(F("Same, before:    "), micros() - start);
+
+    dukeReportDirty = false;
+    start = micros();
+    for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+    {
+        state->PrevFrameNum = 0xFFFF;
+        benchSink = xidReportDue(state, 0, DUKE_POLL_INTERVAL_MS);
+    }
+    report(F("Same, now:       "), micros() - start);
+
+    XboxOGDuke = savedDuke;
+    dukeReportDirty = savedDirty;
+    dropDukeIN();
+}
+
+//Runs the benchmark forever, it never returns.
+void runBenchmark()
+{
+    Serial1.begin(115200);
+    while (1)
+    {
+        uint32_t start;
+
+        start = micros();
+        for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+            benchSink = floatAngle(benchY[i & 7], benchX[i & 7]);
+        report(F("atan2f angle:  "), micros() - start);
+
+        start = micros();
+        for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+            benchSink = iatan2(benchY[i & 7], benchX[i & 7]) + ANGLE_180;
+        report(F("iatan2 angle:  "), micros() - start);
+
+        start = micros();
+        for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+            benchSink = floatMotion(benchX[i & 7], 150 + (i & 63), 45);
+        report(F("float motion:  "), micros() - start);
+
+        #ifdef ENABLE_MOTION
+        start = micros();
+        for (uint16_t i = 0; i < BENCHMARK_LOOPS; i++)
+            benchSink = applyMotion(benchX[i & 7], (150 + (i & 63)) * ANGLE_SCALE);
+        report(F("fixed motion:  "), micros() - start);
+        #endif
+
+        benchmarkDukeReport();
+
+        Serial1.println();
+        delay(5000);
+    }
+}
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * controllers.h
+ *
+ * One adapter per supported USB controller. Each adapter supplies the
+ * button map, trigger/stick scaling and rumble translation for its driver
+ * as static functions. Controller<T> turns them into a ControllerOps_t, and
+ * main.cpp copies the matching one into RAM when a controller connects.
+ * main.cpp calls the adapter through those function pointers, one indirect
+ * call per operation. Inside an adapter the calls into its driver are
+ * direct and can be inlined.
+ *
+ * To add a controller, write an adapter here and add it to CONTROLLERS[] in main.cpp.
+ */
+
+#ifndef CONTROLLERS_H_
+#define CONTROLLERS_H_
+#include "settings.h"
+#include "inputsnapshot.h"
+#include "stickcurve.h"
+#include <XBOXONE.h>
+#include <XBOXUSB.h>
+#include <PS3USB.h>
+#include <PS4USB.h>
+
+extern XBOXONE XboxOneWired;
+extern XBOXUSB Xbox360Wired;
+extern PS3USB PS3Wired;
+extern PS4USB PS4Wired;
+
+typedef struct
+{
+    bool (*connected)();
+    uint32_t (*deviceId)();                       //VID in the high word, PID in the low word
+    uint16_t (*reportSeq)();                      //See ReportSequence
+    void (*read)(InputSnapshot_t *in);            //Fill the snapshot from the last report
+    void (*readMotion)(InputSnapshot_t *in);      //Add the motion sensors to the snapshot, if hasMotion
+    void (*setRumble)(uint8_t lValue, uint8_t rValue);
+    void (*setLed)(LEDEnum led);
+    bool hasMotion;
+    bool stick8Bit;                               //Sticks are 8-bit values expanded to 16 bits
+} ControllerOps_t;
+
+//Buttons that are read the same way on every controller, mapped to their snapshot bits.
+typedef struct
+{
+    uint8_t button; //ButtonEnum
+    uint16_t mask;  //IN_* bit
+} InputButtonMap_t;
+
+#define INPUT_BUTTON_COUNT 15
+
+const InputButtonMap_t XBOX_INPUT_BUTTONS[INPUT_BUTTON_COUNT] PROGMEM = {
+    {UP, IN_DUP}, {DOWN, IN_DDOWN}, {LEFT, IN_DLEFT}, {RIGHT, IN_DRIGHT},
+    {START, IN_START}, {BACK, IN_BACK}, {L3, IN_LS}, {R3, IN_RS},
+    {A, IN_A}, {B, IN_B}, {X, IN_X}, {Y, IN_Y},
+    {L1, IN_WHITE}, {R1, IN_BLACK}, {XBOX, IN_XBOX}};
+
+//Remap the PlayStation face buttons to their Xbox counterparts by position
+const InputButtonMap_t PS_INPUT_BUTTONS[INPUT_BUTTON_COUNT] PROGMEM = {
+    {UP, IN_DUP}, {DOWN, IN_DDOWN}, {LEFT, IN_DLEFT}, {RIGHT, IN_DRIGHT},
+    {START, IN_START}, {SELECT, IN_BACK}, {L3, IN_LS}, {R3, IN_RS},
+    {CROSS, IN_A}, {CIRCLE, IN_B}, {SQUARE, IN_X}, {TRIANGLE, IN_Y},
+    {L1, IN_WHITE}, {R1, IN_BLACK}, {PS, IN_XBOX}};
+
+//Common part of every adapter. T supplies pad(), connected(), buttons(), readAnalog() and
+//rumble(), and may override HAS_MOTION, STICK_8BIT, readMotion() and led().
+template <class T>
+class Controller
+{
+public:
+    static uint16_t reportSeq()
+    {
+        return T::pad().getReportSeq();
+    }
+
+    static uint32_t deviceId()
+    {
+        return ((uint32_t)T::pad().getVID() << 16) | T::pad().getPID();
+    }
+
+    static void read(InputSnapshot_t *in)
+    {
+        memset(in, 0x00, sizeof(InputSnapshot_t));
+        uint16_t buttons = 0;
+        for (uint8_t i = 0; i < INPUT_BUTTON_COUNT; i++)
+        {
+            if (T::pad().getButtonPress((ButtonEnum)pgm_read_byte(&T::buttons()[i].button)))
+                buttons |= pgm_read_word(&T::buttons()[i].mask);
+        }
+        in->buttons = buttons;
+        T::readAnalog(in);
+    }
+
+    static void setRumble(uint8_t lValue, uint8_t rValue)
+    {
+        T::rumble(lValue, rValue);
+    }
+
+    static void setLed(LEDEnum led)
+    {
+        T::led(led);
+    }
+
+    static const bool HAS_MOTION = false;
+    static const bool STICK_8BIT = false;
+    static void readMotion(InputSnapshot_t *in) {}
+
+protected:
+    static void led(LEDEnum led) {}
+
+    //Scale up the unsigned 8bit values produced by the PlayStation analog sticks to the
+    //signed 16bit values expected by the Xbox, using the whole range. In the case of the Y axes, invert the result
+    static void readPSSticks(InputSnapshot_t *in)
+    {
+        in->leftStickX = expandStick8(T::pad().getAnalogHat(LeftHatX));
+        in->leftStickY = expandStick8Inverted(T::pad().getAnalogHat(LeftHatY));
+        in->rightStickX = expandStick8(T::pad().getAnalogHat(RightHatX));
+        in->rightStickY = expandStick8Inverted(T::pad().getAnalogHat(RightHatY));
+    }
+
+    static void rumblePS(uint8_t lValue, uint8_t rValue)
+    {
+        // TO DO - add left and right values
+        if (lValue == 0 && rValue == 0)
+            T::pad().setRumbleOff();
+        else
+            T::pad().setRumbleOn(RumbleLow);
+    }
+};
+
+//Expands to the ControllerOps_t initialiser for adapter T
+#define CONTROLLER_OPS(T) {T::connected, T::deviceId, T::reportSeq, T::read, T::readMotion, T::setRumble, T::setLed, T::HAS_MOTION, T::STICK_8BIT}
+
+class Xbox360Controller : public Controller<Xbox360Controller>
+{
+public:
+    static XBOXUSB &pad() { return Xbox360Wired; }
+    static bool connected() { return Xbox360Wired.Xbox360Connected; }
+    static const InputButtonMap_t *buttons() { return XBOX_INPUT_BUTTONS; }
+
+    static void readAnalog(InputSnapshot_t *in)
+    {
+        in->leftTrigger = Xbox360Wired.getButtonPress(L2);
+        in->rightTrigger = Xbox360Wired.getButtonPress(R2);
+        in->leftStickX = stick(LeftHatX);
+        in->leftStickY = stick(LeftHatY);
+        in->rightStickX = stick(RightHatX);
+        in->rightStickY = stick(RightHatY);
+    }
+
+    static void rumble(uint8_t lValue, uint8_t rValue)
+    {
+        Xbox360Wired.setRumbleOn(lValue, rValue);
+    }
+
+    static void led(LEDEnum led)
+    {
+        Xbox360Wired.setLedOn(led);
+    }
+
+private:
+    static int16_t stick(AnalogHatEnum a)
+    {
+        int16_t val = Xbox360Wired.getAnalogHat(a);
+        #ifndef ENABLE_STICK_CAL
+        if (val == -32512) //8bitdo range fix, stickcal learns this per model instead
+            val = -32768;
+        #endif
+        return val;
+    }
+};
+
+class XboxOneController : public Controller<XboxOneController>
+{
+public:
+    static XBOXONE &pad() { return XboxOneWired; }
+    static bool connected() { return XboxOneWired.XboxOneConnected; }
+    static const InputButtonMap_t *buttons() { return XBOX_INPUT_BUTTONS; }
+
+    static void readAnalog(InputSnapshot_t *in)
+    {
+        //Xbone one triggers are 10-bit, remove 2LSBs so its 8bit like OG Xbox
+        in->leftTrigger = (uint8_t)(XboxOneWired.getButtonPress(L2) >> 2);
+        in->rightTrigger = (uint8_t)(XboxOneWired.getButtonPress(R2) >> 2);
+        in->leftStickX = XboxOneWired.getAnalogHat(LeftHatX);
+        in->leftStickY = XboxOneWired.getAnalogHat(LeftHatY);
+        in->rightStickX = XboxOneWired.getAnalogHat(RightHatX);
+        in->rightStickY = XboxOneWired.getAnalogHat(RightHatY);
+    }
+
+    static void rumble(uint8_t lValue, uint8_t rValue)
+    {
+        XboxOneWired.setRumbleOn(lValue / 8, rValue / 8, lValue / 2, rValue / 2);
+    }
+
+    //no LEDs on Xbox One Controller. I think it is possible to adjust brightness but this is not implemented.
+};
+
+class PS3Controller : public Controller<PS3Controller>
+{
+public:
+    static PS3USB &pad() { return PS3Wired; }
+    static bool connected() { return PS3Wired.PS3Connected; }
+    static const InputButtonMap_t *buttons() { return PS_INPUT_BUTTONS; }
+
+    static void readAnalog(InputSnapshot_t *in)
+    {
+        //The pressure applied to the triggers, not just 'on' or 'off'
+        in->leftTrigger = PS3Wired.getAnalogButton(L2);
+        in->rightTrigger = PS3Wired.getAnalogButton(R2);
+        readPSSticks(in);
+    }
+    static const bool STICK_8BIT = true;
+
+#ifdef ENABLE_MOTION
+    static const bool HAS_MOTION = true;
+    static void readMotion(InputSnapshot_t *in)
+    {
+        // TO DO - allow user to invert motion y axis
+        in->hasMotion = true;
+        in->roll = PS3Wired.getAngleFixed(Roll);
+        in->pitch = ANGLE_360 - PS3Wired.getAngleFixed(Pitch);
+#ifdef ENABLE_GYRO
+        //The Dualshock 3 only has a yaw gyro. It is a 10-bit reading centred on about 512, and is
+        //scaled up to roughly match the DualShock 4. The remaining offset is learnt in gyroaim.cpp
+        in->gyroAxes = GYRO_AXIS_YAW;
+        in->gyroYaw = (512 - (int16_t)PS3Wired.getSensor(gZ)) * 8;
+#endif
+    }
+#endif
+
+    static void rumble(uint8_t lValue, uint8_t rValue)
+    {
+        rumblePS(lValue, rValue);
+    }
+
+    static void led(LEDEnum led)
+    {
+        PS3Wired.setLedOn(led);
+    }
+};
+
+class PS4Controller : public Controller<PS4Controller>
+{
+public:
+    static PS4USB &pad() { return PS4Wired; }
+    static bool connected() { return PS4Wired.connected(); }
+    static const InputButtonMap_t *buttons() { return PS_INPUT_BUTTONS; }
+
+    static void readAnalog(InputSnapshot_t *in)
+    {
+        in->leftTrigger = PS4Wired.getAnalogButton(L2);
+        in->rightTrigger = PS4Wired.getAnalogButton(R2);
+        readPSSticks(in);
+    }
+    static const bool STICK_8BIT = true;
+
+#ifdef ENABLE_MOTION
+    static const bool HAS_MOTION = true;
+    static void readMotion(InputSnapshot_t *in)
+    {
+        in->hasMotion = true;
+        in->roll = ANGLE_360 - PS4Wired.getAngleFixed(Roll);
+        in->pitch = ANGLE_360 - PS4Wired.getAngleFixed(Pitch);
+#ifdef ENABLE_GYRO
+        //Signs match the mirrored angles above
+        in->gyroAxes = GYRO_AXIS_YAW | GYRO_AXIS_PITCH;
+        in->gyroYaw = -PS4Wired.getSensor(gY);
+        in->gyroPitch = -PS4Wired.getSensor(gX);
+#endif
+    }
+#endif
+
+    static void rumble(uint8_t lValue, uint8_t rValue)
+    {
+        rumblePS(lValue, rValue);
+    }
+};
+
+#endif /* CONTROLLERS_H_ */
@@ -8,6 +8,12 @@
 
 #ifndef DUKECONTROLLER_H_
 #define DUKECONTROLLER_H_
+#include "settings.h"
+#include "xiddriver.h"
+
+#if DUKE_POLL_INTERVAL_MS != 1 && DUKE_POLL_INTERVAL_MS != 2 && DUKE_POLL_INTERVAL_MS != 4 && DUKE_POLL_INTERVAL_MS != 8
+#error "DUKE_POLL_INTERVAL_MS must be 1, 2, 4 or 8"
+#endif
 
 /* Digital Button Masks */
 #define DUP (1 << 0)
@@ -19,33 +25,12 @@
 #define LS_BTN (1 << 6)
 #define RS_BTN (1 << 7)
 
-typedef struct
-{
-    uint8_t startByte; //Always 0x00
-    uint8_t bLength;
-    uint8_t dButtons;
-    uint8_t reserved;
-    uint8_t A;
-    uint8_t B;
-    uint8_t X;
-    uint8_t Y;
-    uint8_t BLACK;
-    uint8_t WHITE;
-    uint8_t L;
-    uint8_t R;
-    int16_t leftStickX;
-    int16_t leftStickY;
-    int16_t rightStickX;
-    int16_t rightStickY;
-    //These last few values aren't part of the xbox controller HID report, but are added here by me to store extra stuff.
-    uint8_t left_actuator;
-    uint8_t right_actuator;
-    uint8_t rumbleUpdate;
-} USB_XboxGamepad_Data_t;
+//The Duke and the Controller S share the configuration, report and capabilities. They differ in the
+//product ID and the XID subtype, and a few games only accept one of them.
 
-//Obtained from USB dump of original controller
+//Obtained from USB dump of original controller (Controller S)
 //USB Device descriptor
-const uint8_t PROGMEM DUKE_USB_DESCRIPTOR_DEVICE[] = {
+const uint8_t PROGMEM CONTROLLER_S_USB_DESCRIPTOR_DEVICE[] = {
     0x12,       //bLength - length of packet in bytes
     0x01,       //bDescriptorType - 0x01 = Device Descriptor
     0x10, 0x01, //bcdUSB - 2 bytes. Sets USB Spec 1.1 (0110)
@@ -62,6 +47,24 @@ const uint8_t PROGMEM DUKE_USB_DESCRIPTOR_DEVICE[] = {
     0x01        //bNumConfigurations = 1
 };
 
+//The original (Duke) controller. See http://xboxdevwiki.net/Xbox_Input_Devices
+const uint8_t PROGMEM DUKE_USB_DESCRIPTOR_DEVICE[] = {
+    0x12,       //bLength - length of packet in bytes
+    0x01,       //bDescriptorType - 0x01 = Device Descriptor
+    0x10, 0x01, //bcdUSB - 2 bytes. Sets USB Spec 1.1 (0110)
+    0x00,       //bDeviceClass
+    0x00,       //bDeviceSubClass
+    0x00,       //dDeviceProtocol
+    0x20,       //bMaxPacketSize. Must match FIXED_CONTROL_ENDPOINT_SIZE in LUFAConfig.h
+    0x5E, 0x04, //Vendor ID (LSB First) = 0x045E
+    0x02, 0x02, //Product ID (LSB First) = 0x0202
+    0x00, 0x01, //bcdDevice - 1.00
+    0x00,       //iManufacturer = none
+    0x00,       //iProduct = none
+    0x00,       //iSerialNumber = none
+    0x01        //bNumConfigurations = 1
+};
+
 //Obtained from USB dump of original controller
 //Usb Configuration Descriptor
 const uint8_t PROGMEM DUKE_USB_DESCRIPTOR_CONFIGURATION[] = {
@@ -92,7 +95,7 @@ const uint8_t PROGMEM DUKE_USB_DESCRIPTOR_CONFIGURATION[] = {
     0x81,       //bEndpointAddress, Address=1, Direction IN
     0x03,       //bmAttributes, 3=Interrupt Endpoint
     0x20, 0x00, //wMaxPacketSize
-    0x04,       //bInterval, Interval for polling the interrupt endpoint. 4ms
+    DUKE_POLL_INTERVAL_MS, //bInterval, Interval for polling the interrupt endpoint. See settings.h
 
     //Endpoint Descriptor (OUT)//
     0x07,       //bLength of endpoint descriptor
@@ -100,12 +103,12 @@ const uint8_t PROGMEM DUKE_USB_DESCRIPTOR_CONFIGURATION[] = {
     0x02,       //bEndpointAddress, Address=2, Direction OUT
     0x03,       //bmAttributes, 3=Interrupt Endpoint
     0x20, 0x00, //wMaxPacketSize
-    0x04        //bInterval, Interval for polling the interrupt endpoint. 4ms
+    DUKE_POLL_INTERVAL_MS  //bInterval, Interval for polling the interrupt endpoint. See settings.h
 };
 
 //Obtained from USB analyser dump of original controller when talking to console
 //This is a custom vendor request specific to the xbox controller and an OG xbox.
-const uint8_t DUKE_HID_DESCRIPTOR_XID[] = {
+const uint8_t PROGMEM CONTROLLER_S_HID_DESCRIPTOR_XID[] = {
     0x10,                                          //bLength - Length of report. 16 bytes
     0x42,                                          //bDescriptorType - always 0x42
     0x00, 0x01,                                    //bcdXid
@@ -116,10 +119,21 @@ const uint8_t DUKE_HID_DESCRIPTOR_XID[] = {
     0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF //wAlternateProductIds
 };
 
+const uint8_t PROGMEM DUKE_HID_DESCRIPTOR_XID[] = {
+    0x10,                                          //bLength - Length of report. 16 bytes
+    0x42,                                          //bDescriptorType - always 0x42
+    0x00, 0x01,                                    //bcdXid
+    0x01,                                          //bType - 1=Xbox Gamecontroller
+    0x01,                                          //bSubType, 0x02 = Gamepad S, 0x01 = Gamepad (Duke)
+    0x14,                                          //bMaxInputReportSize //HID Report from controller - 20 bytes
+    0x06,                                          //bMaxOutputReportSize - Rumble report from host - 6 bytes
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF //wAlternateProductIds
+};
+
 //It will have bits set (1) where the bit is valid in the controller button report.
 //If the bit is auto-generated, it will be cleared (0). Refer http://xboxdevwiki.net/Xbox_Input_Devices
 //Obtained from a USB analyser dump when talking with console.
-const uint8_t DUKE_HID_CAPABILITIES_IN[] = {
+const uint8_t PROGMEM DUKE_HID_CAPABILITIES_IN[] = {
     0x00, //Always 0x00
     0x14, //bLength - length of packet in bytes
     0xFF,
@@ -133,7 +147,7 @@ const uint8_t DUKE_HID_CAPABILITIES_IN[] = {
 
 //It will have bits set (1) where the bit is valid in the controller rumnble report.
 //Obtained from a USB analyser dump when talking with console.
-const uint8_t DUKE_HID_CAPABILITIES_OUT[] = {
+const uint8_t PROGMEM DUKE_HID_CAPABILITIES_OUT[] = {
     0x00,                  //Always 0x00
     0x06,                  //bLength - length of packet in bytes
     0xFF, 0xFF, 0xFF, 0xFF //bits corresponding to the rumble bits. all 0xFF as they are used.
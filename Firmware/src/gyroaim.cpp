@@ -0,0 +1,89 @@
+/*
+ * gyroaim.cpp
+ *
+ * See gyroaim.h.
+ */
+
+#include "gyroaim.h"
+#include "settings.h"
+#include <fixedmath.h>
+
+#ifdef ENABLE_GYRO
+
+#define GYRO_FULL_TURN ((int32_t)ANGLE_360 << 8) //360 degrees in 8.8 fixed point
+
+static int32_t limitBias(int32_t bias)
+{
+    if (bias > GYRO_BIAS_LIMIT) return GYRO_BIAS_LIMIT;
+    if (bias < -GYRO_BIAS_LIMIT) return -GYRO_BIAS_LIMIT;
+    return bias;
+}
+
+//The shortest way from one angle to another, -180 to just under +180 degrees
+static int32_t wrapAngle(int32_t angle)
+{
+    angle %= GYRO_FULL_TURN;
+    if (angle >= GYRO_FULL_TURN / 2) angle -= GYRO_FULL_TURN;
+    if (angle < -GYRO_FULL_TURN / 2) angle += GYRO_FULL_TURN;
+    return angle;
+}
+
+static int16_t deadband(int32_t rate)
+{
+    if (rate > -GYRO_DEADBAND && rate < GYRO_DEADBAND)
+        return 0;
+    return rate;
+}
+
+void gyroAxisReset(GyroAxis_t *axis)
+{
+    axis->bias = 0;
+    axis->angle = 0;
+    axis->primed = false;
+}
+
+//Axis with no absolute reference (yaw). The bias is learnt while the controller is still.
+//Returns the rate with the bias removed.
+int16_t gyroAxisRate(GyroAxis_t *axis, int16_t rate)
+{
+    int32_t corrected = (int32_t)rate - (axis->bias >> 8);
+    if (corrected > -GYRO_STILL_THRESHOLD && corrected < GYRO_STILL_THRESHOLD)
+        axis->bias += (((int32_t)rate << 8) - axis->bias) >> GYRO_BIAS_SHIFT;
+    return deadband(corrected);
+}
+
+//Axis with an accelerometer reference (pitch). A complementary filter follows the gyro over short
+//periods and the accelerometer over long ones, and the error between the two corrects the bias.
+//accAngle is in 1/16 degree steps and rate must be positive when it increases. dt is in ms.
+//Returns the rate with the bias removed.
+int16_t gyroAxisRate(GyroAxis_t *axis, int16_t rate, uint16_t accAngle, uint8_t dt)
+{
+    int32_t reference = (int32_t)accAngle << 8;
+    if (!axis->primed)
+    {
+        axis->angle = reference;
+        axis->primed = true;
+    }
+
+    int32_t corrected = (int32_t)rate - (axis->bias >> 8);
+    //16 units per degree/s is 16/1000 of a 1/16 degree step per ms, in 8.8 that's * 0.256, or 131/512
+    axis->angle += (corrected * dt * 131) >> 9;
+
+    //accAngle wraps at 360 degrees, so the error is taken the short way round and the gyro angle is
+    //kept within a turn of it
+    int32_t error = wrapAngle(reference - axis->angle);
+    axis->angle = reference - error + (error >> GYRO_KP_SHIFT);
+    axis->bias = limitBias(axis->bias - (error >> GYRO_KI_SHIFT));
+    return deadband(corrected);
+}
+
+//Add a rate to a stick axis. gain is stick units per rate unit, 8.8 fixed point.
+int16_t gyroToStick(int16_t stick, int16_t rate, int16_t gain)
+{
+    int32_t total = stick + (((int32_t)rate * gain + 128) >> 8);
+    if (total > 32767) return 32767;
+    if (total < -32767) return -32767;
+    return total;
+}
+
+#endif
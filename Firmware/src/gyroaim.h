@@ -0,0 +1,35 @@
+/*
+ * gyroaim.h
+ *
+ * Gyro aiming. The right stick follows the rate the controller is turning
+ * at, rather than how far it is tilted. Integer only, it runs for every
+ * report while gyro aiming is on.
+ *
+ * Gyro rates are raw sensor units, scaled by the controller adapter to
+ * about 16 per degree/s (the DualShock 4 resolution).
+ */
+
+#ifndef GYROAIM_H_
+#define GYROAIM_H_
+#include <inttypes.h>
+
+#define GYRO_DEADBAND 8         //Corrected rates below this are treated as noise
+#define GYRO_STILL_THRESHOLD 48 //About 3 degree/s. Below this the controller is assumed to be still and the bias is learnt
+#define GYRO_BIAS_SHIFT 6       //Time constant of the bias learning, in reports
+#define GYRO_KP_SHIFT 5         //How hard the complementary filter pulls the gyro angle towards the accelerometer angle
+#define GYRO_KI_SHIFT 9         //How quickly the remaining angle error is moved into the bias
+#define GYRO_BIAS_LIMIT (512L << 8) //Keeps a bad estimate from running away
+
+typedef struct
+{
+    int32_t bias;  //Rate offset, 8.8 fixed point
+    int32_t angle; //Gyro angle in 1/16 degree steps, 8.8 fixed point. Only used with an accelerometer reference
+    bool primed;   //angle has been set from the accelerometer
+} GyroAxis_t;
+
+void gyroAxisReset(GyroAxis_t *axis);
+int16_t gyroAxisRate(GyroAxis_t *axis, int16_t rate);
+int16_t gyroAxisRate(GyroAxis_t *axis, int16_t rate, uint16_t accAngle, uint8_t dt);
+int16_t gyroToStick(int16_t stick, int16_t rate, int16_t gain);
+
+#endif /* GYROAIM_H_ */
@@ -0,0 +1,58 @@
+/*
+ * hotkeys.cpp
+ *
+ * See hotkeys.h.
+ */
+
+#include "hotkeys.h"
+
+void hotkeyInit(HotkeyEngine_t *engine, const Hotkey_t *table, uint8_t count)
+{
+    engine->table = table;
+    engine->count = count;
+    hotkeyReset(engine);
+}
+
+void hotkeyReset(HotkeyEngine_t *engine)
+{
+    engine->held = 0;
+    engine->armed = 0;
+    engine->fired = false;
+}
+
+//Call with the buttons of every new report. Does nothing unless they changed.
+void hotkeyInput(HotkeyEngine_t *engine, uint32_t held, uint32_t now)
+{
+    if (held == engine->held)
+        return;
+    engine->held = held;
+
+    uint8_t match = 0;
+    for (uint8_t i = 0; i < engine->count; i++)
+    {
+        uint32_t chord = pgm_read_dword(&engine->table[i].chord);
+        if ((held & chord) == chord)
+        {
+            match = i + 1;
+            break;
+        }
+    }
+
+    //Pressing another button while a chord is held doesn't restart it
+    if (match == engine->armed)
+        return;
+    engine->armed = match;
+    engine->fired = false;
+    if (match)
+        engine->deadline = now + pgm_read_word(&engine->table[match - 1].holdTime);
+}
+
+//Call from the main loop. Runs the action of the held chord once its hold time has passed.
+void hotkeyTask(HotkeyEngine_t *engine, uint32_t now)
+{
+    if (!engine->armed || engine->fired || (int32_t)(now - engine->deadline) < 0)
+        return;
+    engine->fired = true;
+    void (*action)() = (void (*)())pgm_read_ptr(&engine->table[engine->armed - 1].action);
+    action();
+}
@@ -0,0 +1,63 @@
+/*
+ * hotkeys.h
+ *
+ * Table driven hotkeys. Each entry is a chord of buttons that must all be
+ * held, how long for, and the action to run. The table is only searched
+ * when the held buttons change, and the deadline of the matching chord is
+ * a single compare in the main loop, so a chord fires as soon as it has
+ * been held long enough however slow the loop is.
+ *
+ * An action fires once per press. Release any button of the chord to arm
+ * it again. Earlier entries win when more than one chord is held.
+ */
+
+#ifndef HOTKEYS_H_
+#define HOTKEYS_H_
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include "inputsnapshot.h"
+
+//Chords use the IN_* bits, plus the analog triggers treated as buttons
+#define HOTKEY_LT (1UL << 16)
+#define HOTKEY_RT (1UL << 17)
+
+typedef struct
+{
+    uint32_t chord;    //IN_* and HOTKEY_* bits that must all be held
+    uint16_t holdTime; //Milliseconds the chord must be held for, 0 fires on the press
+    void (*action)();
+} Hotkey_t;
+
+typedef struct
+{
+    const Hotkey_t *table; //PROGMEM
+    uint8_t count;
+    uint32_t held;     //Buttons held at the last report
+    uint8_t armed;     //Position of the held chord in the table plus one, or 0 if there isn't one
+    bool fired;        //The armed chord has run its action
+    uint32_t deadline; //millis() at which the armed chord fires
+} HotkeyEngine_t;
+
+void hotkeyInit(HotkeyEngine_t *engine, const Hotkey_t *table, uint8_t count);
+void hotkeyReset(HotkeyEngine_t *engine);
+void hotkeyInput(HotkeyEngine_t *engine, uint32_t held, uint32_t now);
+void hotkeyTask(HotkeyEngine_t *engine, uint32_t now);
+
+//The buttons of a snapshot as a chord
+inline uint32_t hotkeyChord(const InputSnapshot_t *in)
+{
+    uint32_t held = in->buttons;
+    if (in->leftTrigger > 0x00)
+        held |= HOTKEY_LT;
+    if (in->rightTrigger > 0x00)
+        held |= HOTKEY_RT;
+    return held;
+}
+
+//True while a chord in the table is held, fired or not
+inline bool hotkeyActive(const HotkeyEngine_t *engine)
+{
+    return engine->armed;
+}
+
+#endif /* HOTKEYS_H_ */
@@ -0,0 +1,57 @@
+/*
+ * inputsnapshot.h
+ *
+ * Normalised state of the connected USB controller. It is filled once by
+ * the active driver each time a new report arrives and the Duke report is
+ * built from it.
+ */
+
+#ifndef INPUTSNAPSHOT_H_
+#define INPUTSNAPSHOT_H_
+#include <inttypes.h>
+#include "settings.h"
+
+//The low byte matches the Duke dButtons layout so it can be copied straight across.
+#define IN_DUP (1 << 0)
+#define IN_DDOWN (1 << 1)
+#define IN_DLEFT (1 << 2)
+#define IN_DRIGHT (1 << 3)
+#define IN_START (1 << 4)
+#define IN_BACK (1 << 5)
+#define IN_LS (1 << 6)
+#define IN_RS (1 << 7)
+//Face and shoulder buttons. PlayStation pads report the button in the same position, not the one with the same name.
+#define IN_A (1 << 8)
+#define IN_B (1 << 9)
+#define IN_X (1 << 10)
+#define IN_Y (1 << 11)
+#define IN_WHITE (1 << 12) //L1
+#define IN_BLACK (1 << 13) //R1
+#define IN_XBOX (1 << 14) //Guide or PS button
+
+//Valid gyro rates
+#define GYRO_AXIS_YAW (1 << 0)
+#define GYRO_AXIS_PITCH (1 << 1)
+
+typedef struct
+{
+    uint16_t buttons;     //IN_* bits
+    uint8_t leftTrigger;  //0x00 to 0xFF
+    uint8_t rightTrigger; //0x00 to 0xFF
+    int16_t leftStickX;   //Xbox range and direction, up is positive
+    int16_t leftStickY;
+    int16_t rightStickX;
+    int16_t rightStickY;
+#ifdef ENABLE_MOTION
+    bool hasMotion;   //Only set by controllers with motion sensors, while motion aiming is on
+    uint16_t roll;    //1/16 degree steps (see fixedmath.h), 0 to 5760, 2880 is level
+    uint16_t pitch;
+#ifdef ENABLE_GYRO
+    uint8_t gyroAxes; //GYRO_AXIS_* bits
+    int16_t gyroYaw;  //About 16 per degree/s (see gyroaim.h), turning right is positive
+    int16_t gyroPitch; //Positive when pitch increases
+#endif
+#endif
+} InputSnapshot_t;
+
+#endif /* INPUTSNAPSHOT_H_ */
@@ -50,5 +50,8 @@
 #define USE_FLASH_DESCRIPTORS
 #define FIXED_CONTROL_ENDPOINT_SIZE      32
 #define FIXED_NUM_CONFIGURATIONS         1
+/* Answer control requests from the USB_COM interrupt, so enumeration and the XID vendor requests
+   don't wait for the main loop (which can be held up by the USB host side) */
+#define INTERRUPT_CONTROL_ENDPOINT
 
 #endif
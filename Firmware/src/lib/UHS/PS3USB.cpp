@@ -32,6 +32,7 @@ bPollEnable(false) // don't start polling before dongle is connected
                 epInfo[i].bmRcvToggle = 0;
                 epInfo[i].bmNakPower = (i) ? USB_NAK_NOWAIT : USB_NAK_MAX_POWER;
         }
+        inHandle.pep = NULL;
 
         if(pUsb) // register in USB subsystem
                 pUsb->RegisterDeviceClass(this); //set devConfig[] entry
@@ -50,8 +51,6 @@ uint8_t PS3USB::Init(uint8_t parent, uint8_t port, bool lowspeed) {
         uint8_t rcode;
         UsbDevice *p = NULL;
         EpInfo *oldep_ptr = NULL;
-        uint16_t PID;
-        uint16_t VID;
 
         // get memory address of USB device address pool
         AddressPool &addrPool = pUsb->GetAddressPool();
@@ -169,6 +168,11 @@ uint8_t PS3USB::Init(uint8_t parent, uint8_t port, bool lowspeed) {
         if(rcode)
                 goto FailSetDevTblEntry;
 
+        // Resolve the input endpoint once, so Poll() doesn't have to search the address pool on every transfer
+        rcode = pUsb->getEpHandle(bAddress, epInfo[ PS3_INPUT_PIPE ].epAddr, &inHandle);
+        if(rcode)
+                goto FailSetDevTblEntry;
+
         delay(200); //Give time for address change
 
         rcode = pUsb->setConf(bAddress, epInfo[ PS3_CONTROL_PIPE ].epAddr, 1);
@@ -188,7 +192,9 @@ uint8_t PS3USB::Init(uint8_t parent, uint8_t port, bool lowspeed) {
 // #endif
 //                         PS3NavigationConnected = true;
 //                 }
-                enable_sixaxis(); // The PS3 controller needs a special command before it starts sending data
+                // The PS3 controller needs a special command before it starts sending data. It is sent from Poll()
+                cmdQueue.Reset();
+                cmdQueue.Push(PS3_CMD_ENABLE_SIXAXIS);
 
                 // Needed for PS3 Dualshock and Navigation commands to work
                 for(uint8_t i = 0; i < PS3_REPORT_BUFFER_SIZE; i++)
@@ -265,9 +271,13 @@ uint8_t PS3USB::Release() {
         PS3Connected = false;
         PS3MoveConnected = false;
         PS3NavigationConnected = false;
+        VID = 0;
+        PID = 0;
         pUsb->GetAddressPool().FreeAddress(bAddress);
         bAddress = 0;
         bPollEnable = false;
+        inHandle.pep = NULL;
+        cmdQueue.Reset();
         return 0;
 }
 
@@ -277,8 +287,8 @@ uint8_t PS3USB::Poll() {
 
         if(PS3Connected || PS3NavigationConnected) {
                 uint16_t BUFFER_SIZE = EP_MAXPKTSIZE;
-                pUsb->inTransfer(bAddress, epInfo[ PS3_INPUT_PIPE ].epAddr, &BUFFER_SIZE, readBuf); // input on endpoint 1
-                if((int32_t)((uint32_t)millis() - timer) > 100) { // Loop 100ms before processing data
+                uint8_t rcode = pUsb->inTransfer(&inHandle, &BUFFER_SIZE, readBuf); // input on endpoint 1
+                if(!rcode && BUFFER_SIZE && (int32_t)((uint32_t)millis() - timer) > 100) { // Loop 100ms before processing data
                         readReport();
 #ifdef PRINTREPORT
                         printReport(); // Uncomment "#define PRINTREPORT" to print the report send by the PS3 Controllers
@@ -290,9 +300,30 @@ uint8_t PS3USB::Poll() {
         //                 timer = (uint32_t)millis();
         //         }
         }
+        sendQueuedCommand();
         return 0;
 }
 
+void PS3USB::sendQueuedCommand() {
+        if(cmdQueue.Empty())
+                return;
+
+        uint8_t rcode = hrSUCCESS;
+        switch(cmdQueue.Peek()) {
+                case PS3_CMD_ENABLE_SIXAXIS:
+                        rcode = enable_sixaxis();
+                        break;
+                case PS3_CMD_LED1:
+                        writeBuf[9] |= (uint8_t)((pgm_read_byte(&PS3_LEDS[(uint8_t)LED1]) & 0x0f) << 1); // As setLedOn(LED1)
+                        rcode = PS3_Command(writeBuf, PS3_REPORT_BUFFER_SIZE);
+                        break;
+        }
+        if(rcode == hrSUCCESS)
+                cmdQueue.Pop();
+        else
+                cmdQueue.Failed(PS3_CMD_MAX_RETRIES);
+}
+
 void PS3USB::readReport() {
         ButtonState = (uint32_t)(readBuf[2] | ((uint16_t)readBuf[3] << 8) | ((uint32_t)readBuf[4] << 16));
 
@@ -303,6 +334,7 @@ void PS3USB::readReport() {
                 ButtonClickState = ButtonState & ~OldButtonState; // Update click state variable
                 OldButtonState = ButtonState;
         }
+        reportReceived();
 }
 
 void PS3USB::printReport() { // Uncomment "#define PRINTREPORT" to print the report send by the PS3 Controllers
@@ -338,23 +370,22 @@ uint16_t PS3USB::getSensor(SensorEnum a) {
         return ((readBuf[((uint16_t)a) - 9] << 8) | readBuf[((uint16_t)a + 1) - 9]);
 }
 
-float PS3USB::getAngle(AngleEnum a) {
+uint16_t PS3USB::getAngleFixed(AngleEnum a) {
         if(PS3Connected) {
-                float accXval, accYval, accZval;
+                int16_t accXval, accYval, accZval;
 
                 // Data for the Kionix KXPC4 used in the DualShock 3
-                const float zeroG = 511.5f; // 1.65/3.3*1023 (1,65V)
-                accXval = -((float)getSensor(aX) - zeroG);
-                accYval = -((float)getSensor(aY) - zeroG);
-                accZval = -((float)getSensor(aZ) - zeroG);
-
-                // Convert to 360 degrees resolution
-                // atan2 outputs the value of -π to π (radians)
-                // We are then converting it to 0 to 2π and then to degrees
+                // zeroG is 511.5 (1.65/3.3*1023), so the values are doubled to keep the half. atan2 only cares about the ratio
+                const int16_t zeroG2 = 1023;
+                accXval = -((int16_t)(getSensor(aX) << 1) - zeroG2);
+                accYval = -((int16_t)(getSensor(aY) << 1) - zeroG2);
+                accZval = -((int16_t)(getSensor(aZ) << 1) - zeroG2);
+
+                // atan2 outputs the value of -180 to 180 degrees, we are then converting it to 0 to 360
                 if(a == Pitch)
-                        return (atan2f(accYval, accZval) + PI) * RAD_TO_DEG;
+                        return iatan2(accYval, accZval) + ANGLE_180;
                 else
-                        return (atan2f(accXval, accZval) + PI) * RAD_TO_DEG;
+                        return iatan2(accXval, accZval) + ANGLE_180;
         } else
                 return 0;
 }
@@ -397,9 +428,9 @@ bool PS3USB::getStatus(StatusEnum c) {
 // }
 
 /* Playstation Sixaxis Dualshock and Navigation Controller commands */
-void PS3USB::PS3_Command(uint8_t *data, uint16_t nbytes) {
+uint8_t PS3USB::PS3_Command(uint8_t *data, uint16_t nbytes) {
         // bmRequest = Host to device (0x00) | Class (0x20) | Interface (0x01) = 0x21, bRequest = Set Report (0x09), Report ID (0x01), Report Type (Output 0x02), interface (0x00), datalength, datalength, data)
-        pUsb->ctrlReq(bAddress, epInfo[PS3_CONTROL_PIPE].epAddr, bmREQ_HID_OUT, HID_REQUEST_SET_REPORT, 0x01, 0x02, 0x00, nbytes, nbytes, data, NULL);
+        return pUsb->ctrlReq(bAddress, epInfo[PS3_CONTROL_PIPE].epAddr, bmREQ_HID_OUT, HID_REQUEST_SET_REPORT, 0x01, 0x02, 0x00, nbytes, nbytes, data, NULL);
 }
 
 void PS3USB::setAllOff() {
@@ -487,7 +518,7 @@ void PS3USB::setLedToggle(LEDEnum a) {
 //                 bdaddr[5 - i] = buf[i + 2]; // Copy into buffer reversed, so it is LSB first
 // }
 
-void PS3USB::enable_sixaxis() { // Command used to enable the Dualshock 3 and Navigation controller to send data via USB
+uint8_t PS3USB::enable_sixaxis() { // Command used to enable the Dualshock 3 and Navigation controller to send data via USB
         uint8_t cmd_buf[4];
         cmd_buf[0] = 0x42; // Special PS3 Controller enable commands
         cmd_buf[1] = 0x0c;
@@ -495,7 +526,7 @@ void PS3USB::enable_sixaxis() { // Command used to enable the Dualshock 3 and Na
         cmd_buf[3] = 0x00;
 
         // bmRequest = Host to device (0x00) | Class (0x20) | Interface (0x01) = 0x21, bRequest = Set Report (0x09), Report ID (0xF4), Report Type (Feature 0x03), interface (0x00), datalength, datalength, data)
-        pUsb->ctrlReq(bAddress, epInfo[PS3_CONTROL_PIPE].epAddr, bmREQ_HID_OUT, HID_REQUEST_SET_REPORT, 0xF4, 0x03, 0x00, 4, 4, cmd_buf, NULL);
+        return pUsb->ctrlReq(bAddress, epInfo[PS3_CONTROL_PIPE].epAddr, bmREQ_HID_OUT, HID_REQUEST_SET_REPORT, 0xF4, 0x03, 0x00, 4, 4, cmd_buf, NULL);
 }
 
 /* Playstation Move Controller commands */
@@ -572,6 +603,6 @@ void PS3USB::onInit() {
                 //         moveSetBulb(Red);
                 // else // Dualshock 3 or Navigation controller
                 //         setLedOn(static_cast<LEDEnum>(LED1));
-                setLedOn(static_cast<LEDEnum>(LED1));
+                cmdQueue.Push(PS3_CMD_LED1);
         }
 }
@@ -21,6 +21,9 @@
 #include "Usb.h"
 #include "usbhid.h"
 #include "PS3Enums.h"
+#include "cmdqueue.h"
+#include "reportseq.h"
+#include "fixedmath.h"
 
 /* PS3 data taken from descriptors */
 #define EP_MAXPKTSIZE           64 // max size for data via USB
@@ -38,6 +41,11 @@
 
 #define PS3_MAX_ENDPOINTS       3
 
+/* Commands queued by Init() and sent from Poll() */
+#define PS3_CMD_ENABLE_SIXAXIS  0
+#define PS3_CMD_LED1            1
+#define PS3_CMD_MAX_RETRIES     5 // Failed sends before a queued command is dropped. The control transfer already waits out NAKs
+
 /**
  * This class implements support for all the official PS3 Controllers:
  * Dualshock 3, Navigation or a Motion controller via USB.
@@ -46,7 +54,7 @@
  *
  * Information about the protocol can be found at the wiki: https://github.com/felis/USB_Host_Shield_2.0/wiki/PS3-Information.
  */
-class PS3USB : public USBDeviceConfig {
+class PS3USB : public USBDeviceConfig, public ReportSequence {
 public:
         /**
          * Constructor for the PS3USB class.
@@ -177,7 +185,15 @@ public:
          * @param  a Either ::Pitch or ::Roll.
          * @return   Return the angle in the range of 0-360.
          */
-        float getAngle(AngleEnum a);
+        float getAngle(AngleEnum a) {
+                return (float)getAngleFixed(a) / ANGLE_SCALE;
+        };
+        /**
+         * Integer version of getAngle(AngleEnum a), without the soft-float library.
+         * @param  a Either ::Pitch or ::Roll.
+         * @return   Return the angle in 1/16 degree steps, in the range of 0-5760.
+         */
+        uint16_t getAngleFixed(AngleEnum a);
         /**
          * Get the ::StatusEnum from the controller.
          * @param  c The ::StatusEnum you want to read.
@@ -256,6 +272,15 @@ public:
         };
         /**@}*/
 
+        /** @return The VID of the connected device, or 0. */
+        uint16_t getVID() {
+                return VID;
+        };
+        /** @return The PID of the connected device, or 0. */
+        uint16_t getPID() {
+                return PID;
+        };
+
         /** Variable used to indicate if the normal playstation controller is successfully connected. */
         bool PS3Connected;
         /** Variable used to indicate if the move controller is successfully connected. */
@@ -270,6 +295,10 @@ protected:
         uint8_t bAddress;
         /** Endpoint info structure. */
         EpInfo epInfo[PS3_MAX_ENDPOINTS];
+        /** Pre-resolved input endpoint used by Poll(). */
+        EpHandle inHandle;
+        /** VID and PID of the connected device. */
+        uint16_t VID, PID;
 
 private:
         /**
@@ -280,6 +309,9 @@ private:
         void onInit();
         void (*pFuncOnInit)(void); // Pointer to function called in onInit()
 
+        CommandQueue<2> cmdQueue; // Start-up handshake, sent one command per Poll()
+        void sendQueuedCommand(); // Send the next queued command, if any
+
         bool bPollEnable;
 
         uint32_t timer; // used to continuously set PS3 Move controller Bulb and rumble values
@@ -296,8 +328,8 @@ private:
         void printReport(); // print incoming date - Uncomment for debugging
 
         /* Private commands */
-        void PS3_Command(uint8_t *data, uint16_t nbytes);
-        void enable_sixaxis(); // Command used to enable the Dualshock 3 and Navigation controller to send data via USB
+        uint8_t PS3_Command(uint8_t *data, uint16_t nbytes);
+        uint8_t enable_sixaxis(); // Command used to enable the Dualshock 3 and Navigation controller to send data via USB
         void Move_Command(uint8_t *data, uint16_t nbytes);
 };
 #endif
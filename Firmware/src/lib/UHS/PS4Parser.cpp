@@ -121,6 +121,7 @@ void PS4Parser::Parse(uint8_t len, uint8_t *buf) {
                                 oldDpad = newDpad;
                         }
                 }
+                reportReceived();
         }
 
         if (ps4Output.reportChanged)
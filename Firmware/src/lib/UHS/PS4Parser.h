@@ -20,6 +20,8 @@
 
 #include "Usb.h"
 #include "controllerEnums.h"
+#include "reportseq.h"
+#include "fixedmath.h"
 
 /** Buttons on the controller */
 const uint8_t PS4_BUTTONS[] PROGMEM = {
@@ -121,7 +123,7 @@ struct PS4Output {
 } __attribute__((packed));
 
 /** This class parses all the data sent by the PS4 controller */
-class PS4Parser {
+class PS4Parser : public ReportSequence {
 public:
         /** Constructor for the PS4Parser class. */
         PS4Parser() {
@@ -213,10 +215,19 @@ public:
          * @return   Return the angle in the range of 0-360.
          */
         float getAngle(AngleEnum a) {
+                return (float)getAngleFixed(a) / ANGLE_SCALE;
+        };
+
+        /**
+         * Integer version of getAngle(AngleEnum a), without the soft-float library.
+         * @param  a Either ::Pitch or ::Roll.
+         * @return   Return the angle in 1/16 degree steps, in the range of 0-5760.
+         */
+        uint16_t getAngleFixed(AngleEnum a) {
                 if (a == Pitch)
-                        return (atan2f(ps4Data.accY, ps4Data.accZ) + PI) * RAD_TO_DEG;
+                        return iatan2(ps4Data.accY, ps4Data.accZ) + ANGLE_180;
                 else
-                        return (atan2f(ps4Data.accX, ps4Data.accZ) + PI) * RAD_TO_DEG;
+                        return iatan2(ps4Data.accX, ps4Data.accZ) + ANGLE_180;
         };
 
         /**
@@ -48,6 +48,15 @@ public:
                 return HIDUniversal::isReady() && HIDUniversal::VID == PS4_VID && (HIDUniversal::PID == PS4_PID || HIDUniversal::PID == PS4_PID_SLIM);
         };
 
+        /** @return The VID of the connected device. */
+        uint16_t getVID() {
+                return HIDUniversal::VID;
+        };
+        /** @return The PID of the connected device. */
+        uint16_t getPID() {
+                return HIDUniversal::PID;
+        };
+
         /**
          * Used to call your own function when the device is successfully initialized.
          * @param funcOnInit Function to call.
@@ -22,8 +22,9 @@ static uint8_t usb_error = 0;
 static uint8_t usb_task_state;
 
 /* constructor */
-USB::USB() : bmHubPre(0) {
+USB::USB() : bmHubPre(0), curPerAddr(0xFF), curLowSpeed(false) {
         usb_task_state = USB_DETACHED_SUBSTATE_INITIALIZE; //set up state machine
+        memset(&xferStats, 0, sizeof(xferStats));
         init();
 }
 
@@ -31,6 +32,8 @@ USB::USB() : bmHubPre(0) {
 void USB::init() {
         //devConfigIndex = 0;
         bmHubPre = 0;
+        curPerAddr = 0xFF; // PERADDR and MODE have to be written again by the next transfer
+        curLowSpeed = false;
 }
 
 uint8_t USB::getUsbTaskState(void) {
@@ -77,6 +80,29 @@ uint8_t USB::setEpInfoEntry(uint8_t addr, uint8_t epcount, EpInfo* eprecord_ptr)
         return 0;
 }
 
+/* resolve an endpoint once so that the transfer functions taking an EpHandle can skip SetAddress() lookups */
+uint8_t USB::getEpHandle(uint8_t addr, uint8_t ep, EpHandle *handle) {
+        EpInfo *pep = NULL;
+        uint16_t nak_limit = 0;
+
+        if(!handle)
+                return USB_ERROR_INVALID_ARGUMENT;
+
+        handle->pep = NULL;
+
+        uint8_t rcode = SetAddress(addr, ep, &pep, &nak_limit);
+
+        if(rcode)
+                return rcode;
+
+        handle->pep = pep;
+        handle->nak_limit = nak_limit;
+        handle->addr = addr;
+        handle->lowspeed = addrPool.GetUsbDevicePtr(addr)->lowspeed;
+
+        return 0;
+}
+
 uint8_t USB::SetAddress(uint8_t addr, uint8_t ep, EpInfo **ppep, uint16_t *nak_limit) {
         UsbDevice *p = addrPool.GetUsbDevicePtr(addr);
 
@@ -114,9 +140,28 @@ uint8_t USB::SetAddress(uint8_t addr, uint8_t ep, EpInfo **ppep, uint16_t *nak_l
         // Set bmLOWSPEED and bmHUBPRE in case of low-speed device, reset them otherwise
         regWr(rMODE, (p->lowspeed) ? mode | bmLOWSPEED | bmHubPre : mode & ~(bmHUBPRE | bmLOWSPEED));
 
+        curPerAddr = addr;
+        curLowSpeed = p->lowspeed;
+
         return 0;
 }
 
+/* Same as above for a pre-resolved endpoint. PERADDR and MODE are only written when they differ from what the */
+/* previous transfer used, so polling a single device costs no extra SPI traffic. Full speed MODE bits are kept */
+/* in step by busprobe(), low speed devices always get a fresh MODE in case bmHUBPRE changed.                   */
+void USB::SetAddress(const EpHandle *handle) {
+        if(curPerAddr != handle->addr) {
+                regWr(rPERADDR, handle->addr); //set peripheral address
+                curPerAddr = handle->addr;
+        }
+
+        if(handle->lowspeed || curLowSpeed) {
+                uint8_t mode = regRd(rMODE);
+                regWr(rMODE, (handle->lowspeed) ? mode | bmLOWSPEED | bmHubPre : mode & ~(bmHUBPRE | bmLOWSPEED));
+                curLowSpeed = handle->lowspeed;
+        }
+}
+
 /* Control transfer. Sets address, endpoint, fills control packet with necessary data, dispatches control packet, and initiates bulk IN transfer,   */
 /* depending on request. Actual requests are defined as inlines                                                                                      */
 /* return codes:                */
@@ -221,6 +266,14 @@ uint8_t USB::inTransfer(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t*
         return InTransfer(pep, nak_limit, nbytesptr, data, bInterval);
 }
 
+uint8_t USB::inTransfer(EpHandle *handle, uint16_t *nbytesptr, uint8_t* data, uint8_t bInterval /*= 0*/) {
+        if(!handle->pep)
+                return USB_ERROR_EPINFO_IS_NULL;
+
+        SetAddress(handle);
+        return InTransfer(handle->pep, handle->nak_limit, nbytesptr, data, bInterval);
+}
+
 uint8_t USB::InTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t *nbytesptr, uint8_t* data, uint8_t bInterval /*= 0*/) {
         uint8_t rcode = 0;
         uint8_t pktsize;
@@ -312,6 +365,14 @@ uint8_t USB::outTransfer(uint8_t addr, uint8_t ep, uint16_t nbytes, uint8_t* dat
         return OutTransfer(pep, nak_limit, nbytes, data);
 }
 
+uint8_t USB::outTransfer(EpHandle *handle, uint16_t nbytes, uint8_t* data) {
+        if(!handle->pep)
+                return USB_ERROR_EPINFO_IS_NULL;
+
+        SetAddress(handle);
+        return OutTransfer(handle->pep, handle->nak_limit, nbytes, data);
+}
+
 uint8_t USB::OutTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t nbytes, uint8_t *data) {
         uint8_t rcode = hrSUCCESS, retry_count;
         uint8_t *data_p = data; //local copy of the data pointer
@@ -433,17 +494,22 @@ uint8_t USB::dispatchPkt(uint8_t token, uint8_t ep, uint16_t nak_limit) {
                 rcode = (regRd(rHRSL) & 0x0f); //analyze transfer result
 
                 switch(rcode) {
+                        case hrSUCCESS:
+                                return (rcode);
                         case hrNAK:
+                                xferStats.naks++;
                                 nak_count++;
                                 if(nak_limit && (nak_count == nak_limit))
                                         return (rcode);
                                 break;
                         case hrTIMEOUT:
+                                xferStats.timeouts++;
                                 retry_count++;
                                 if(retry_count == USB_RETRY_LIMIT)
                                         return (rcode);
                                 break;
                         default:
+                                xferStats.errors++;
                                 return (rcode);
                 }//switch( rcode
 
@@ -198,6 +198,16 @@ typedef struct {
         uint16_t wLength; //   6      Depends on bRequest
 } __attribute__((packed)) SETUP_PKT, *PSETUP_PKT;
 
+/* Pre-resolved endpoint, filled once by USB::getEpHandle() when a driver is initialized.      */
+/* Transfers made through a handle skip the address pool and endpoint table lookups.           */
+/* The handle is only valid until the device is released or its endpoint table is replaced.    */
+struct EpHandle {
+        EpInfo *pep; // endpoint record, NULL when not resolved
+        uint16_t nak_limit; // NAK limit derived from bmNakPower
+        uint8_t addr; // device address
+        bool lowspeed; // indicates if a device is the low speed one
+};
+
 
 
 // Base class for incoming data parser
@@ -207,10 +217,20 @@ public:
         virtual void Parse(const uint16_t len, const uint8_t *pbuf, const uint16_t &offset) = 0;
 };
 
+// Packet results counted by USB::dispatchPkt(), for diagnostics. The counts wrap.
+typedef struct {
+        uint32_t naks; // NAK handshakes, each retried
+        uint32_t timeouts; // Bus timeouts, each retried up to USB_RETRY_LIMIT times
+        uint32_t errors; // Packets that ended with any other error
+} USB_XFER_STATS;
+
 class USB : public MAX3421E {
         AddressPoolImpl<USB_NUMDEVICES> addrPool;
         USBDeviceConfig* devConfig[USB_NUMDEVICES];
         uint8_t bmHubPre;
+        uint8_t curPerAddr; // last address written to PERADDR, 0xFF if unknown
+        bool curLowSpeed; // MODE was last set up for a low speed device
+        USB_XFER_STATS xferStats;
 
 public:
         USB(void);
@@ -243,8 +263,13 @@ public:
         uint8_t getUsbTaskState(void);
         void setUsbTaskState(uint8_t state);
 
+        const USB_XFER_STATS& getXferStats() {
+                return xferStats;
+        };
+
         EpInfo* getEpInfoEntry(uint8_t addr, uint8_t ep);
         uint8_t setEpInfoEntry(uint8_t addr, uint8_t epcount, EpInfo* eprecord_ptr);
+        uint8_t getEpHandle(uint8_t addr, uint8_t ep, EpHandle *handle);
 
         /* Control requests */
         uint8_t getDevDescr(uint8_t addr, uint8_t ep, uint16_t nbytes, uint8_t* dataptr);
@@ -260,6 +285,8 @@ public:
         uint8_t ctrlStatus(uint8_t ep, bool direction, uint16_t nak_limit);
         uint8_t inTransfer(uint8_t addr, uint8_t ep, uint16_t *nbytesptr, uint8_t* data, uint8_t bInterval = 0);
         uint8_t outTransfer(uint8_t addr, uint8_t ep, uint16_t nbytes, uint8_t* data);
+        uint8_t inTransfer(EpHandle *handle, uint16_t *nbytesptr, uint8_t* data, uint8_t bInterval = 0);
+        uint8_t outTransfer(EpHandle *handle, uint16_t nbytes, uint8_t* data);
         uint8_t dispatchPkt(uint8_t token, uint8_t ep, uint16_t nak_limit);
 
         void Task(void);
@@ -274,6 +301,7 @@ public:
 private:
         void init();
         uint8_t SetAddress(uint8_t addr, uint8_t ep, EpInfo **ppep, uint16_t *nak_limit);
+        void SetAddress(const EpHandle *handle);
         uint8_t OutTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t nbytes, uint8_t *data);
         uint8_t InTransfer(EpInfo *pep, uint16_t nak_limit, uint16_t *nbytesptr, uint8_t *data, uint8_t bInterval = 0);
         uint8_t AttemptConfig(uint8_t driver, uint8_t parent, uint8_t port, bool lowspeed);
@@ -38,6 +38,8 @@ bPollEnable(false) { // don't start polling before dongle is connected
                 epInfo[i].bmRcvToggle = 0;
                 epInfo[i].bmNakPower = (i) ? USB_NAK_NOWAIT : USB_NAK_MAX_POWER;
         }
+        inHandle.pep = NULL;
+        outHandle.pep = NULL;
 
         if(pUsb) // register in USB subsystem
                 pUsb->RegisterDeviceClass(this); //set devConfig[] entry
@@ -49,7 +51,6 @@ uint8_t XBOXONE::Init(uint8_t parent, uint8_t port, bool lowspeed) {
         uint8_t rcode;
         UsbDevice *p = NULL;
         EpInfo *oldep_ptr = NULL;
-        uint16_t PID, VID;
         uint8_t num_of_conf; // Number of configurations
 
         // get memory address of USB device address pool
@@ -166,6 +167,13 @@ uint8_t XBOXONE::Init(uint8_t parent, uint8_t port, bool lowspeed) {
         if(rcode)
                 goto FailSetDevTblEntry;
 
+        // Resolve the endpoints once, so Poll() doesn't have to search the address pool on every transfer
+        rcode = pUsb->getEpHandle(bAddress, epInfo[ XBOX_ONE_INPUT_PIPE ].epAddr, &inHandle);
+        if(!rcode)
+                rcode = pUsb->getEpHandle(bAddress, epInfo[ XBOX_ONE_OUTPUT_PIPE ].epAddr, &outHandle);
+        if(rcode)
+                goto FailSetDevTblEntry;
+
         delay(200); // Give time for address change
 
         rcode = pUsb->setConf(bAddress, epInfo[ XBOX_ONE_CONTROL_PIPE ].epAddr, bConfNum);
@@ -176,19 +184,12 @@ uint8_t XBOXONE::Init(uint8_t parent, uint8_t port, bool lowspeed) {
         Notify(PSTR("\r\nXbox One Controller Connected\r\n"), 0x80);
 #endif
 
-        delay(200); // let things settle
-
-        // Initialize the controller for input
+        // The handshake is queued rather than sent here, so the input endpoint is polled straight away
+        // and the first report isn't held up by the commands. Poll() sends them once things have settled.
         cmdCounter = 0; // Reset the counter used when sending out the commands
-        uint8_t writeBuf[5];
-        writeBuf[0] = 0x05;
-        writeBuf[1] = 0x20;
-        // Byte 2 is set in "XboxCommand"
-        writeBuf[3] = 0x01;
-        writeBuf[4] = 0x00;
-        rcode = XboxCommand(writeBuf, 5);
-        if (rcode)
-                goto Fail;
+        cmdQueue.Reset();
+        cmdQueue.Push(XBOX_ONE_CMD_POWER_ON); // Initialize the controller for input
+        cmdNotBefore = (uint32_t)millis() + XBOX_ONE_CMD_SETTLE_TIME;
 
         onInit();
         XboxOneConnected = true;
@@ -285,12 +286,17 @@ void XBOXONE::PrintEndpointDescriptor(const USB_ENDPOINT_DESCRIPTOR* ep_ptr
 /* Performs a cleanup after failed Init() attempt */
 uint8_t XBOXONE::Release() {
         XboxOneConnected = false;
+        VID = 0;
+        PID = 0;
         pUsb->GetAddressPool().FreeAddress(bAddress);
         bAddress = 0; // Clear device address
         bNumEP = 1; // Must have to be reset to 1
         qNextPollTime = 0; // Reset next poll time
         pollInterval = 0;
         bPollEnable = false;
+        inHandle.pep = NULL;
+        outHandle.pep = NULL;
+        cmdQueue.Reset();
 #ifdef DEBUG_USB_HOST
         Notify(PSTR("\r\nXbox One Controller Disconnected\r\n"), 0x80);
 #endif
@@ -306,7 +312,7 @@ uint8_t XBOXONE::Poll() {
         if((int32_t)((uint32_t)millis() - qNextPollTime) >= 0L) { // Do not poll if shorter than polling interval
                 qNextPollTime = (uint32_t)millis() + pollInterval; // Set new poll time
                 uint16_t length =  (uint16_t)epInfo[ XBOX_ONE_INPUT_PIPE ].maxPktSize; // Read the maximum packet size from the endpoint
-                uint8_t rcode = pUsb->inTransfer(bAddress, epInfo[ XBOX_ONE_INPUT_PIPE ].epAddr, &length, readBuf, pollInterval);
+                uint8_t rcode = pUsb->inTransfer(&inHandle, &length, readBuf, pollInterval);
                 if(!rcode) {
                         readReport();
 #ifdef PRINTREPORT // Uncomment "#define PRINTREPORT" to print the report send by the Xbox ONE Controller
@@ -323,10 +329,61 @@ uint8_t XBOXONE::Poll() {
                         NotifyFail(rcode);
                 }
 #endif
+                sendQueuedCommand();
     }
     return rcode;
 }
 
+void XBOXONE::sendQueuedCommand() {
+        if(cmdQueue.Empty() || (int32_t)((uint32_t)millis() - cmdNotBefore) < 0L)
+                return;
+
+        uint8_t writeBuf[5];
+        uint8_t rcode;
+
+        switch(cmdQueue.Peek()) {
+                case XBOX_ONE_CMD_POWER_ON:
+                        writeBuf[0] = 0x05;
+                        writeBuf[1] = 0x20;
+                        // Byte 2 is set in "XboxCommand"
+                        writeBuf[3] = 0x01;
+                        writeBuf[4] = 0x00;
+                        rcode = XboxCommand(writeBuf, 5);
+                        break;
+                case XBOX_ONE_CMD_RUMBLE_OFF:
+                        setRumbleOff();
+                        rcode = hrSUCCESS;
+                        break;
+                default:
+                        rcode = hrSUCCESS;
+                        break;
+        }
+
+        if(rcode == hrSUCCESS) {
+                cmdQueue.Pop();
+                return;
+        }
+
+        cmdCounter--; // Send it again with the same sequence number
+        if(rcode == hrNAK)
+                return; // The controller is busy, try again on the next poll
+
+#ifdef DEBUG_USB_HOST
+        Notify(PSTR("\r\nXbox One Command Failed, error code: "), 0x80);
+        NotifyFail(rcode);
+#endif
+        uint8_t cmd = cmdQueue.Peek();
+        if(!cmdQueue.Failed(XBOX_ONE_CMD_MAX_RETRIES)) {
+                cmdNotBefore = (uint32_t)millis() + XBOX_ONE_CMD_RETRY_TIME;
+                return;
+        }
+
+        // Without the power on the controller never sends any input. Rather than leave it looking
+        // connected, have USB::Task() release it and enumerate it again, which starts the handshake over
+        if(cmd == XBOX_ONE_CMD_POWER_ON)
+                pUsb->setUsbTaskState(USB_DETACHED_SUBSTATE_INITIALIZE);
+}
+
 void XBOXONE::readReport() {
         if(readBuf[0] == 0x07) {
                 // The XBOX button has a separate message
@@ -339,6 +396,7 @@ void XBOXONE::readReport() {
                     ButtonClickState = ButtonState & ~OldButtonState; // Update click state variable
                     OldButtonState = ButtonState;
                 }
+                reportReceived();
         }
         if(readBuf[0] != 0x20) { // Check if it's the correct report, otherwise return - the controller also sends different status reports
 #ifdef EXTRADEBUG
@@ -375,6 +433,7 @@ void XBOXONE::readReport() {
         if(triggerValue[1] != 0 && triggerValueOld[1] == 0)
                 R2Clicked = true;
         triggerValueOld[1] = triggerValue[1];
+        reportReceived();
 }
 
 uint16_t XBOXONE::getButtonPress(ButtonEnum b) {
@@ -412,7 +471,7 @@ int16_t XBOXONE::getAnalogHat(AnalogHatEnum a) {
 /* Xbox Controller commands */
 uint8_t XBOXONE::XboxCommand(uint8_t* data, uint16_t nbytes) {
         data[2] = cmdCounter++; 
-        uint8_t rcode = pUsb->outTransfer(bAddress, epInfo[ XBOX_ONE_OUTPUT_PIPE ].epAddr, nbytes, data);
+        uint8_t rcode = pUsb->outTransfer(&outHandle, nbytes, data);
 #ifdef DEBUG_USB_HOST
         Notify(PSTR("\r\nXboxCommand, Return: "), 0x80);
         D_PrintHex<uint8_t > (rcode, 0x80);
@@ -442,7 +501,7 @@ void XBOXONE::onInit() {
         writeBuf[11] = 0x00; // Off period
         writeBuf[12] = 0x00; // Repeat count
         XboxCommand(writeBuf, 13);*/
-		setRumbleOff();
+		cmdQueue.Push(XBOX_ONE_CMD_RUMBLE_OFF);
 
         if(pFuncOnInit)
                 pFuncOnInit(); // Call the user function
@@ -25,6 +25,8 @@
 
 #include "Usb.h"
 #include "xboxEnums.h"
+#include "cmdqueue.h"
+#include "reportseq.h"
 
 /* Xbox One data taken from descriptors */
 #define XBOX_ONE_EP_MAXPKTSIZE                  64 // Max size for data via USB
@@ -36,6 +38,13 @@
 
 #define XBOX_ONE_MAX_ENDPOINTS                  3
 
+/* Commands queued by Init() and sent from Poll() */
+#define XBOX_ONE_CMD_POWER_ON                   0
+#define XBOX_ONE_CMD_RUMBLE_OFF                 1
+#define XBOX_ONE_CMD_SETTLE_TIME                200 // ms to wait after the configuration is set before sending the first command
+#define XBOX_ONE_CMD_RETRY_TIME                 50 // ms to wait before sending a command again after it failed
+#define XBOX_ONE_CMD_MAX_RETRIES                5 // Failed sends before giving up on a command. The device is enumerated again if it is the power on
+
 // PID and VID of the different versions of the controller - see: https://github.com/torvalds/linux/blob/master/drivers/input/joystick/xpad.c
 
 // Official controllers
@@ -68,7 +77,7 @@
 #define XBOX_ONE_PID17                          0x02A8 // PDP Wired Controller
 
 /** This class implements support for a Xbox ONE controller connected via USB. */
-class XBOXONE : public USBDeviceConfig, public UsbConfigXtracter {
+class XBOXONE : public USBDeviceConfig, public UsbConfigXtracter, public ReportSequence {
 public:
         /**
          * Constructor for the XBOXONE class.
@@ -197,6 +206,15 @@ public:
         void setRumbleOn(uint8_t leftTrigger, uint8_t rightTrigger, uint8_t leftMotor, uint8_t rightMotor);
         /**@}*/
 
+        /** @return The VID of the connected device, or 0. */
+        uint16_t getVID() {
+                return VID;
+        };
+        /** @return The PID of the connected device, or 0. */
+        uint16_t getPID() {
+                return PID;
+        };
+
         /** True if a Xbox ONE controller is connected. */
         bool XboxOneConnected;
 		
@@ -207,6 +225,11 @@ protected:
         uint8_t bAddress;
         /** Endpoint info structure. */
         EpInfo epInfo[XBOX_ONE_MAX_ENDPOINTS];
+        /** Pre-resolved input and output endpoints used by Poll() and XboxCommand(). */
+        EpHandle inHandle;
+        EpHandle outHandle;
+        /** VID and PID of the connected device. */
+        uint16_t VID, PID;
 
         /** Configuration number. */
         uint8_t bConfNum;
@@ -258,7 +281,11 @@ private:
         uint8_t readBuf[XBOX_ONE_EP_MAXPKTSIZE]; // General purpose buffer for input data
         uint8_t cmdCounter;
 
+        CommandQueue<4> cmdQueue; // Start-up handshake, sent one command per Poll()
+        uint32_t cmdNotBefore; // Time the next queued command may be sent
+
         void readReport(); // Used to read the incoming data
+        void sendQueuedCommand(); // Send the next queued command, if any
 
         /* Private commands */
         uint8_t XboxCommand(uint8_t* data, uint16_t nbytes);
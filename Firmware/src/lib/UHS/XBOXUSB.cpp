@@ -20,6 +20,14 @@ e-mail   :  kristianl@tkjelectronics.com
 //#define EXTRADEBUG // Uncomment to get even more debugging data
 //#define PRINTREPORT // Uncomment to print the report send by the Xbox 360 Controller
 
+/* Start-up handshake, see onInit() */
+const uint8_t XBOX_INIT_COMMANDS[][3] PROGMEM = {
+    {0x01, 0x03, 0x02},
+    {0x01, 0x03, 0x06},
+    {0x02, 0x08, 0x03}, //Not sure what this. Seen in windows driver
+    {0x00, 0x03, 0x00}, //Turn off rumble?
+};
+
 XBOXUSB::XBOXUSB(USB *p) : pUsb(p),     // pointer to USB class instance - mandatory
                            bAddress(0), // device address - mandatory
                            bPollEnable(false)
@@ -32,6 +40,8 @@ XBOXUSB::XBOXUSB(USB *p) : pUsb(p),     // pointer to USB class instance - manda
         epInfo[i].bmRcvToggle = 0;
         epInfo[i].bmNakPower = (i) ? USB_NAK_NOWAIT : USB_NAK_MAX_POWER;
     }
+    inHandle.pep = NULL;
+    outHandle.pep = NULL;
 
     if (pUsb)                            // register in USB subsystem
         pUsb->RegisterDeviceClass(this); //set devConfig[] entry
@@ -44,8 +54,6 @@ uint8_t XBOXUSB::Init(uint8_t parent, uint8_t port, bool lowspeed)
     uint8_t rcode;
     UsbDevice *p = NULL;
     EpInfo *oldep_ptr = NULL;
-    uint16_t PID;
-    uint16_t VID;
     bool v114;		// 2 Wired Controller Versions: 1.10 & 1.14
 
     // get memory address of USB device address pool
@@ -172,6 +180,13 @@ uint8_t XBOXUSB::Init(uint8_t parent, uint8_t port, bool lowspeed)
     if (rcode)
         goto FailSetDevTblEntry;
 
+    // Resolve the endpoints once, so Poll() doesn't have to search the address pool on every transfer
+    rcode = pUsb->getEpHandle(bAddress, epInfo[XBOX_INPUT_PIPE].epAddr, &inHandle);
+    if (!rcode)
+        rcode = pUsb->getEpHandle(bAddress, epInfo[XBOX_OUTPUT_PIPE].epAddr, &outHandle);
+    if (rcode)
+        goto FailSetDevTblEntry;
+
     delay(200); // Give time for address change
 
     rcode = pUsb->setConf(bAddress, epInfo[XBOX_CONTROL_PIPE].epAddr, 1);
@@ -224,9 +239,14 @@ Fail:
 uint8_t XBOXUSB::Release()
 {
     Xbox360Connected = false;
+    VID = 0;
+    PID = 0;
     pUsb->GetAddressPool().FreeAddress(bAddress);
     bAddress = 0;
     bPollEnable = false;
+    inHandle.pep = NULL;
+    outHandle.pep = NULL;
+    cmdQueue.Reset();
     return 0;
 }
 
@@ -235,14 +255,42 @@ uint8_t XBOXUSB::Poll()
     if (!bPollEnable)
         return 0;
     uint16_t BUFFER_SIZE = EP_MAXPKTSIZE;
-    pUsb->inTransfer(bAddress, epInfo[XBOX_INPUT_PIPE].epAddr, &BUFFER_SIZE, readBuf); // input on endpoint 1
-    readReport();
+    uint8_t rcode = pUsb->inTransfer(&inHandle, &BUFFER_SIZE, readBuf); // input on endpoint 1
+    if (!rcode && BUFFER_SIZE >= XBOX_REPORT_BUFFER_SIZE) // Only parse the buffer if a new report actually arrived
+    {
+        readReport();
 #ifdef PRINTREPORT
-    printReport(); // Uncomment "#define PRINTREPORT" to print the report send by the Xbox 360 Controller
+        printReport(); // Uncomment "#define PRINTREPORT" to print the report send by the Xbox 360 Controller
 #endif
+    }
+    sendQueuedCommand();
     return 0;
 }
 
+void XBOXUSB::sendQueuedCommand()
+{
+    if (cmdQueue.Empty() || millis() - outPipeTimer < 2)
+        return;
+
+    uint8_t cmd = cmdQueue.Peek();
+    if (cmd == XBOX_CMD_LED1)
+    {
+        writeBuf[0] = 0x01;
+        writeBuf[1] = 0x03;
+        writeBuf[2] = pgm_read_byte(&XBOX_LEDS[(uint8_t)LED1]) + 4;
+    }
+    else
+        memcpy_P(writeBuf, XBOX_INIT_COMMANDS[cmd], 3);
+
+    // A single attempt, the endpoint is set to not wait on NAKs. If the controller isn't ready, try again on the next poll
+    uint8_t rcode = pUsb->outTransfer(&outHandle, 3, writeBuf);
+    if (rcode == hrSUCCESS)
+        cmdQueue.Pop();
+    else
+        cmdQueue.Failed(XBOX_CMD_MAX_RETRIES);
+    outPipeTimer = millis();
+}
+
 void XBOXUSB::readReport()
 {
     if (readBuf == NULL)
@@ -268,6 +316,7 @@ void XBOXUSB::readReport()
             L2Clicked = true;
         OldButtonState = ButtonState;
     }
+    reportReceived();
 }
 
 void XBOXUSB::printReport()
@@ -334,7 +383,7 @@ void XBOXUSB::XboxCommand(uint8_t *data, uint16_t nbytes)
 
     timeout= millis();
     while (rcode != hrSUCCESS && (millis() - timeout) < 50)
-        rcode = pUsb->outTransfer(bAddress, epInfo[XBOX_OUTPUT_PIPE].epAddr, nbytes, data);
+        rcode = pUsb->outTransfer(&outHandle, nbytes, data);
 
     //Readback any response
     rcode = hrSUCCESS;
@@ -342,8 +391,8 @@ void XBOXUSB::XboxCommand(uint8_t *data, uint16_t nbytes)
     while (rcode != hrNAK && (millis() - timeout) < 50)
     {
         uint16_t bufferSize = EP_MAXPKTSIZE;
-        rcode = pUsb->inTransfer(bAddress, epInfo[XBOX_INPUT_PIPE].epAddr, &bufferSize, readBuf);
-        if (bufferSize > 0)
+        rcode = pUsb->inTransfer(&inHandle, &bufferSize, readBuf);
+        if (!rcode && bufferSize >= XBOX_REPORT_BUFFER_SIZE)
             readReport();
     }
     outPipeTimer = millis();
@@ -401,18 +450,16 @@ void XBOXUSB::onInit()
     pUsb->ctrlReq(bAddress, epInfo[XBOX_CONTROL_PIPE].epAddr, 0x80, 0x06, 0x02, 0x03, 0x0409, 0x0022, 10, stringDescriptor, NULL);
     delay(1);
 
-
-    uint8_t outBuf0[3] = {0x01, 0x03, 0x02};
-    uint8_t outBuf1[3] = {0x01, 0x03, 0x06};
-    uint8_t outBuf2[3] = {0x02, 0x08, 0x03}; //Not sure what this. Seen in windows driver
-    uint8_t outBuf3[3] = {0x00, 0x03, 0x00}; //Turn off rumble?
-    XboxCommand(outBuf0, 3);
-    XboxCommand(outBuf1, 3);
-    XboxCommand(outBuf2, 3);
-    XboxCommand(outBuf3, 3);
+    // The rest of the handshake is sent from Poll(), one command at a time, so the controller is
+    // read from straight away instead of after four blocking output transfers
+    cmdQueue.Reset();
+    cmdQueue.Push(XBOX_CMD_INIT0);
+    cmdQueue.Push(XBOX_CMD_INIT1);
+    cmdQueue.Push(XBOX_CMD_INIT2);
+    cmdQueue.Push(XBOX_CMD_INIT3);
 
     if (pFuncOnInit)
         pFuncOnInit(); // Call the user function
     else
-        setLedOn(static_cast<LEDEnum>(LED1));
+        cmdQueue.Push(XBOX_CMD_LED1);
 }
@@ -21,6 +21,8 @@
 #include "Usb.h"
 #include "usbhid.h"
 #include "xboxEnums.h"
+#include "cmdqueue.h"
+#include "reportseq.h"
 
 /* Data Xbox 360 taken from descriptors */
 #define EP_MAXPKTSIZE 32 // max size for data via USB
@@ -62,10 +64,18 @@
 
 #define XBOX_REPORT_BUFFER_SIZE 14 // Size of the input report buffer
 
+/* Commands queued by onInit() and sent from Poll() */
+#define XBOX_CMD_INIT0 0 // The first four are indices into XBOX_INIT_COMMANDS
+#define XBOX_CMD_INIT1 1
+#define XBOX_CMD_INIT2 2
+#define XBOX_CMD_INIT3 3
+#define XBOX_CMD_LED1 4
+#define XBOX_CMD_MAX_RETRIES 50 // Failed sends, NAKs included, before a queued command is dropped. At least 100ms
+
 //#define XBOX_MAX_ENDPOINTS   3
 
 /** This class implements support for a Xbox wired controller via USB. */
-class XBOXUSB : public USBDeviceConfig
+class XBOXUSB : public USBDeviceConfig, public ReportSequence
 {
 public:
     /**
@@ -229,6 +239,15 @@ public:
     };
     /**@}*/
 
+    /** @return The VID of the connected device, or 0. */
+    uint16_t getVID() {
+        return VID;
+    };
+    /** @return The PID of the connected device, or 0. */
+    uint16_t getPID() {
+        return PID;
+    };
+
     /** True if a Xbox 360 controller is connected. */
     bool Xbox360Connected;
 
@@ -242,6 +261,11 @@ protected:
     uint8_t bAddress;
     /** Endpoint info structure. */
     EpInfo epInfo[3];
+    /** Pre-resolved input and output endpoints used by Poll() and XboxCommand(). */
+    EpHandle inHandle;
+    EpHandle outHandle;
+    /** VID and PID of the connected device. */
+    uint16_t VID, PID;
 
 private:
     /**
@@ -252,6 +276,9 @@ private:
     void onInit();
     void (*pFuncOnInit)(void); // Pointer to function called in onInit()
 
+    CommandQueue<5> cmdQueue; // Start-up handshake, sent one command per Poll()
+    void sendQueuedCommand(); // Send the next queued command, if any
+
     bool bPollEnable;
 
     /* Variables to store the buttons */
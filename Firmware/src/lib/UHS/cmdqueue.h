@@ -0,0 +1,90 @@
+/* This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ */
+
+#ifndef _cmdqueue_h_
+#define _cmdqueue_h_
+
+#include <inttypes.h>
+
+/**
+ * Small FIFO of driver specific command codes.
+ *
+ * Drivers push the commands of their start-up handshake here from Init() instead of sending them
+ * back to back, and send one per Poll() after the input endpoint has been serviced.
+ * Only the codes are stored, the driver builds the packet when the command is sent, so a queue costs
+ * SIZE + 3 bytes of RAM. A command stays at the front until it has been sent, or has failed too often.
+ */
+template <uint8_t SIZE>
+class CommandQueue {
+public:
+        CommandQueue() {
+                Reset();
+        };
+
+        /** Drop all pending commands. */
+        void Reset() {
+                head = 0;
+                count = 0;
+                retries = 0;
+        };
+
+        /**
+         * Add a command to the end of the queue.
+         * @param  cmd Driver specific command code.
+         * @return     False if the queue is full.
+         */
+        bool Push(uint8_t cmd) {
+                if(count >= SIZE)
+                        return false;
+                cmds[(uint8_t)(head + count) % SIZE] = cmd;
+                count++;
+                return true;
+        };
+
+        /** @return True if there is nothing left to send. */
+        bool Empty() const {
+                return !count;
+        };
+
+        /** @return The command at the front of the queue. Only valid if Empty() returns false. */
+        uint8_t Peek() const {
+                return cmds[head];
+        };
+
+        /** Remove the command at the front of the queue, once it has been sent. */
+        void Pop() {
+                if(count) {
+                        head = (head + 1) % SIZE;
+                        count--;
+                }
+                retries = 0;
+        };
+
+        /**
+         * Note that sending the command at the front failed, so it is sent again on a later Poll().
+         * @param  maxRetries Failed attempts after which the command is dropped.
+         * @return            True if the command was dropped.
+         */
+        bool Failed(uint8_t maxRetries) {
+                if(++retries < maxRetries)
+                        return false;
+                Pop();
+                return true;
+        };
+
+private:
+        uint8_t cmds[SIZE];
+        uint8_t head;
+        uint8_t count;
+        uint8_t retries; // Failed attempts to send the command at the front
+};
+
+#endif
@@ -0,0 +1,71 @@
+/* This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ */
+
+#ifndef _fixedmath_h_
+#define _fixedmath_h_
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+/* Angles are in 1/16 degree steps */
+#define ANGLE_SCALE             16
+#define ANGLE_90                (90 * ANGLE_SCALE)
+#define ANGLE_180               (180 * ANGLE_SCALE)
+#define ANGLE_360               (360 * ANGLE_SCALE)
+
+/* atan(i / 64) in 1/16 degree steps, for i = 0 to 64 */
+const uint16_t ATAN_LUT[65] PROGMEM = {
+        0, 14, 29, 43, 57, 71, 86, 100,
+        114, 128, 142, 156, 170, 184, 197, 211,
+        225, 238, 251, 265, 278, 291, 304, 316,
+        329, 341, 354, 366, 378, 390, 402, 414,
+        425, 436, 448, 459, 470, 481, 491, 502,
+        512, 522, 532, 542, 552, 562, 571, 581,
+        590, 599, 608, 617, 626, 634, 642, 651,
+        659, 667, 675, 683, 690, 698, 705, 713,
+        720
+};
+
+/**
+ * Integer replacement for atan2f.
+ *
+ * The ratio of the smaller to the larger magnitude is looked up in ATAN_LUT and linearly interpolated,
+ * then moved into the right octant. Costs one 32-bit division instead of the soft-float library.
+ * The result is within 1/16 degree of atan2f.
+ * @param  y Any value.
+ * @param  x Any value.
+ * @return   atan2(y, x) in 1/16 degree steps, -2880 to 2880.
+ */
+inline int16_t iatan2(int16_t y, int16_t x) {
+        uint16_t ax = (x < 0) ? -(uint16_t)x : x;
+        uint16_t ay = (y < 0) ? -(uint16_t)y : y;
+        uint16_t mx = (ax >= ay) ? ax : ay;
+        uint16_t mn = (ax >= ay) ? ay : ax;
+        if(!mx)
+                return 0;
+
+        uint16_t ratio = (uint16_t)(((uint32_t)mn << 15) / mx); // 0 to 32768
+        uint8_t i = ratio >> 9;
+        uint16_t frac = ratio & 0x1FF;
+        int16_t angle = pgm_read_word(&ATAN_LUT[i]);
+        if(frac) // i is always below 64 here
+                angle += (int16_t)(((uint32_t)(pgm_read_word(&ATAN_LUT[i + 1]) - angle) * frac + 0x100) >> 9);
+
+        if(ay > ax)
+                angle = ANGLE_90 - angle;
+        if(x < 0)
+                angle = ANGLE_180 - angle;
+        if(y < 0)
+                angle = -angle;
+        return angle;
+}
+
+#endif
@@ -52,6 +52,7 @@ void HIDUniversal::Initialize() {
         for(uint8_t i = 0; i < maxHidInterfaces; i++) {
                 hidInterfaces[i].bmInterface = 0;
                 hidInterfaces[i].bmProtocol = 0;
+                epInHandle[i].pep = NULL;
 
                 for(uint8_t j = 0; j < maxEpPerInterface; j++)
                         hidInterfaces[i].epIndex[j] = 0;
@@ -229,6 +230,14 @@ uint8_t HIDUniversal::Init(uint8_t parent, uint8_t port, bool lowspeed) {
         if(rcode)
                 goto FailSetConfDescr;
 
+        // Resolve the interrupt IN endpoints once, so Poll() doesn't have to search the address pool on every transfer
+        for(uint8_t i = 0; i < bNumIface; i++) {
+                rcode = pUsb->getEpHandle(bAddress, epInfo[hidInterfaces[i].epIndex[epInterruptInIndex]].epAddr, &epInHandle[i]);
+
+                if(rcode)
+                        goto FailSetDevTblEntry;
+        }
+
         for(uint8_t i = 0; i < bNumIface; i++) {
                 if(hidInterfaces[i].epIndex[epInterruptInIndex] == 0)
                         continue;
@@ -344,6 +353,9 @@ uint8_t HIDUniversal::Release() {
         bAddress = 0;
         qNextPollTime = 0;
         bPollEnable = false;
+
+        for(uint8_t i = 0; i < maxHidInterfaces; i++)
+                epInHandle[i].pep = NULL;
         return 0;
 }
 
@@ -381,7 +393,7 @@ uint8_t HIDUniversal::Poll() {
 
                         ZeroMemory(constBuffLen, buf);
 
-                        uint8_t rcode = pUsb->inTransfer(bAddress, epInfo[index].epAddr, &read, buf);
+                        uint8_t rcode = pUsb->inTransfer(&epInHandle[i], &read, buf);
 
                         if(rcode) {
                                 if(rcode != hrNAK)
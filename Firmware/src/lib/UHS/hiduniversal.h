@@ -63,6 +63,7 @@ class HIDUniversal : public USBHID {
 protected:
         EpInfo epInfo[totalEndpoints];
         HIDInterface hidInterfaces[maxHidInterfaces];
+        EpHandle epInHandle[maxHidInterfaces]; // Pre-resolved interrupt IN endpoint of each interface, used by Poll()
 
         bool bHasReportId;
 
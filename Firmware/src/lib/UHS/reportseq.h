@@ -0,0 +1,51 @@
+/* This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ */
+
+#ifndef _reportseq_h_
+#define _reportseq_h_
+
+#include "Usb.h"
+
+/**
+ * Freshness information for the input reports of a driver.
+ *
+ * The sequence number is only advanced when a transfer succeeded and the report passed the driver's checks,
+ * so a caller can compare it with the value it saw last time and skip its own work if nothing new has arrived.
+ * It wraps at 16 bits, only compare it for equality.
+ */
+class ReportSequence {
+public:
+        ReportSequence() : reportSeq(0), reportTime(0) {
+        };
+
+        /** @return Number of valid reports received so far. */
+        uint16_t getReportSeq() const {
+                return reportSeq;
+        };
+
+        /** @return Value of millis() when the last valid report was received. */
+        uint32_t getReportTime() const {
+                return reportTime;
+        };
+
+protected:
+        /** Call once a report has been received and parsed. */
+        void reportReceived() {
+                reportSeq++;
+                reportTime = (uint32_t)millis();
+        };
+
+private:
+        uint16_t reportSeq;
+        uint32_t reportTime;
+};
+
+#endif
@@ -17,19 +17,36 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 
 In settings.h you can configure the following options:
 1. Compile for MASTER of SLAVE (comment out #define MASTER) (Host is default)
-2. Enable or disable Steel Battalion Controller Support via Wireless Xbox 360 Chatpad (Enabled by Default)
+2. Enable or disable Steel Battalion Controller emulation from a standard pad, optionally with a keyboard (Disabled by Default)
 3. Enable or disable Xbox 360 Wired Support (Enabled by default)
 4. Enable or disable Xbox One Wired Support (Disabled by default)
 */
 
 #include "settings.h"
 #include "xiddevice.h"
+#include "inputsnapshot.h"
+#include "controllers.h"
+#include "gyroaim.h"
+#include "stickcurve.h"
+#include "stickfilter.h"
+#include "stickcal.h"
+#include "hotkeys.h"
+#include "turbo.h"
+#include "scheduler.h"
+#include "telemetry.h"
+#include "battalion.h"
 // #include "EEPROM.h" // ?? Remove this ??
 #include <SPI.h>
+#include <util/atomic.h>
+#include <avr/eeprom.h>
 #include <XBOXONE.h>
 #include <XBOXUSB.h>
 #include <PS3USB.h>
 #include <PS4USB.h>
+#include <fixedmath.h>
+#ifdef ENABLE_BATTALION_KEYBOARD
+#include <usbhub.h>
+#endif
 
 #ifdef ENABLE_OLED
 #include <SSD1306Ascii.h>
@@ -40,16 +57,37 @@ In settings.h you can configure the following options:
 // uint8_t playerID;
 //Xbox gamepad data structure to store all button and actuator states for all four controllers.
 USB_XboxGamepad_Data_t XboxOGDuke;
+//Normalised state of the connected controller, refreshed when a new report arrives.
+InputSnapshot_t input;
 //Default XID device to emulate
-uint8_t ConnectedXID = DUKE_CONTROLLER;
+volatile uint8_t ConnectedXID = DUKE_CONTROLLER;
 //Flag is set when the device has been successfully setup by the OG Xbox
-bool enumerationComplete = false;
+volatile bool enumerationComplete = false;
 //Timer used to time disconnection between SB and Duke controller swapover
 uint32_t disconnectTimer = 0;
+//XID personality to start with, see hotkeyPersonality()
+uint8_t EEMEM storedPersonality;
+//Sequence number of the controller report last mapped into XboxOGDuke
+uint16_t mappedReportSeq = 0;
+//Set when the mapping changes without a new report arriving (controller swap, motion settings)
+bool remapReport = true;
+//Set when the report of the connected XID (XboxOGDuke or XboxOGBattalion) has changed since it was last sent to the OG Xbox
+bool dukeReportDirty = true;
+//Buttons last written to XboxOGDuke by setDukeButtons()
+uint16_t dukeButtons = 0;
+//Sequence number of the last rumble levels read from the console, see DukeReadRumble()
+uint8_t rumbleSeen = 0;
 
 USB UsbHost;
-uint8_t getButtonPress(ButtonEnum b);
-int16_t getAnalogHat(AnalogHatEnum a);
+void readInputSnapshot(InputSnapshot_t *in);
+void setDukeButtons(uint16_t buttons);
+void mapDukeReport();
+#ifdef SUPPORTBATTALION
+void mapBattalionReport();
+void sendBattalionReport(uint16_t frame);
+#endif
+void sendDukeReport(uint16_t frame);
+bool xidReportDue(USB_ClassInfo_HID_Device_State_t *state, uint16_t frame, uint8_t interval);
 void setRumbleOn(uint8_t lValue, uint8_t rValue);
 void setLedOn(LEDEnum led); // TO DO - do something with this
 uint8_t controllerConnected();
@@ -61,39 +99,144 @@ XBOXONE XboxOneWired(&UsbHost);
 XBOXUSB Xbox360Wired(&UsbHost);
 PS3USB PS3Wired(&UsbHost); //defines EP_MAXPKTSIZE = 64. The change causes a compiler warning but doesn't seem to affect operation
 PS4USB PS4Wired(&UsbHost);
+#ifdef SUPPORTBATTALION
+//Built from the same input as the Duke report while the Steel Battalion personality is selected
+USB_XboxSteelBattalion_Data_t XboxOGBattalion;
+Battalion_t battalion;
+#ifdef ENABLE_BATTALION_KEYBOARD
+USBHub UsbHub(&UsbHost);
+HIDBoot<USB_HID_PROTOCOL_KEYBOARD> Keyboard(&UsbHost);
+BattalionKeyboard battalionKeys;
+//battalionKeys.changes() when the keys were last mapped
+uint16_t mappedKeysSeq = 0;
+#endif
+#endif
+//Adapters for the supported controllers, see controllers.h
+const ControllerOps_t CONTROLLERS[] PROGMEM = {
+    CONTROLLER_OPS(Xbox360Controller),
+    CONTROLLER_OPS(XboxOneController),
+    CONTROLLER_OPS(PS3Controller),
+    CONTROLLER_OPS(PS4Controller)};
+#define CONTROLLER_COUNT (sizeof(CONTROLLERS) / sizeof(ControllerOps_t))
+//Copy of the entry for the connected controller, only valid while controllerType is not zero
+ControllerOps_t controller;
+//Position of the connected controller in CONTROLLERS[] plus one, or 0 if there isn't one
 uint8_t controllerType = 0;
 uint8_t status = 0;
+#ifdef ENABLE_STICK_CURVE
+//Deadzone and response curve applied to both sticks, see stickcurve.h
+uint8_t stickProfile = STICK_PROFILE_BYPASS;
+StickCurve_t stickCurve;
+void changeStickProfile();
+#endif
+#ifdef ENABLE_STICK_CAL
+//Centre and range correction of the connected controller, see stickcal.h
+StickCal_t stickCal;
+#endif
+#ifdef ENABLE_STICK_FILTER
+//Left X, left Y, right X, right Y
+StickFilterAxis_t stickFilter[4];
+void resetStickFilter();
+#endif
+
+void hotkeyMotionMode();
+void hotkeyMotionSensitivity();
+void hotkeyStickProfile();
+void hotkeyRumble();
+void hotkeyPersonality();
+void hotkeyStopRumble();
+#ifdef ENABLE_TURBO
+void hotkeyTurboA();
+void hotkeyTurboB();
+void hotkeyTurboX();
+void hotkeyTurboY();
+#endif
+//Hold times in milliseconds
+const Hotkey_t HOTKEYS[] PROGMEM = {
+    #ifdef ENABLE_MOTION
+    {IN_XBOX | HOTKEY_RT, 1000, hotkeyMotionMode},
+    {IN_XBOX | IN_BLACK, 1000, hotkeyMotionSensitivity},
+    #endif
+    #ifdef ENABLE_STICK_CURVE
+    {IN_XBOX | IN_WHITE, 1000, hotkeyStickProfile},
+    #endif
+    #ifdef ENABLE_TURBO
+    {IN_XBOX | IN_A, 1000, hotkeyTurboA},
+    {IN_XBOX | IN_B, 1000, hotkeyTurboB},
+    {IN_XBOX | IN_X, 1000, hotkeyTurboX},
+    {IN_XBOX | IN_Y, 1000, hotkeyTurboY},
+    #endif
+    {IN_XBOX | IN_BACK, 3000, hotkeyPersonality}, //Re-enumerates, so it takes a longer hold
+    #ifdef ENABLE_RUMBLE
+    {IN_XBOX | HOTKEY_LT, 1000, hotkeyRumble},
+    //START+BACK TRIGGERS is a standard soft reset command
+    {IN_START | IN_BACK | HOTKEY_LT | HOTKEY_RT, 0, hotkeyStopRumble},
+    #endif
+};
+HotkeyEngine_t hotkeys;
+#ifdef ENABLE_TURBO
+//Turbo and auto fire settings of each button, see turbo.h
+Turbo_t turbo;
+void changeTurbo(uint16_t button);
+#endif
 
 #ifdef ENABLE_RUMBLE
 bool rumbleOn = false;
 #endif
 
 #ifdef ENABLE_MOTION
-int16_t getMotion(AngleEnum a);
 int16_t limitValue(int32_t value, int32_t maxVal, int32_t minVal);
 void changeMotionSensitivity();
 void applyMotionSensitivity();
-
-bool motionOn = false;
+int16_t applyMotion(int16_t stick, uint16_t angle);
+void changeMotionMode();
+
+#define MOTION_OFF 0
+#define MOTION_TILT 1 //Right stick offset by how far the controller is tilted
+#define MOTION_GYRO 2 //Right stick offset by how fast the controller is turning
+uint8_t motionMode = MOTION_OFF;
+#ifdef ENABLE_GYRO
+void applyGyro(const InputSnapshot_t *in);
+GyroAxis_t gyroYaw;
+GyroAxis_t gyroPitch;
+uint32_t gyroTime = 0;
+int16_t gyroGain; // Stick units per gyro unit, 8.8 fixed point
+#endif
 int8_t motionSensitivity = 1;
 int8_t sensitivityAngle = 45;
-uint16_t rollAngle = 0; // PS controllers provide 0 - 360
-uint16_t pitchAngle = 0;
-int16_t relativeRollAngle = 0; // Will be between [-45 and 45]
-int16_t relativePitchAngle = 0;
-float lookXAdjust_f = 0;
-float lookYAdjust_f = 0;
-int32_t totalX = 0;
-int32_t totalY = 0;
-uint16_t maxInputAngle;
+uint16_t maxInputAngle; // 1/16 degree steps, like the PS controllers provide
 uint16_t minInputAngle;
+int16_t motionGain; // Stick units per 1/16 degree of tilt, 8.8 fixed point
 #endif
 
 #ifdef ENABLE_OLED
 void updateOled();
 SSD1306AsciiAvrI2c oled;
+//Set when the OLED needs redrawing, see taskOled()
+bool oledDirty = false;
 #endif
 
+void taskUsbHost();
+void taskInput();
+void taskCommands();
+void taskAttach();
+#ifdef ENABLE_OLED
+void taskOled();
+#endif
+//Main loop tasks, see scheduler.h. Times are in microseconds.
+//The Duke report has the tightest deadline, so it goes first whenever it is due.
+const SchedulerTask_t TASKS[] PROGMEM = {
+    //run, period, deadline, budget
+    {sendControllerHIDReport, 1000, 1000, 300},
+    {taskInput, 1000, 2000, 1500},
+    {taskUsbHost, 1000, 4000, 2000},
+    {taskCommands, 16000, 16000, 2000},
+    {taskAttach, 10000, 20000, 200},
+    #ifdef ENABLE_OLED
+    {taskOled, 50000, 100000, 30000},
+    #endif
+};
+
 int main(void)
 {
     //Init the Arduino Library
@@ -106,6 +249,7 @@ int main(void)
     digitalWrite(ARDUINO_LED_PIN, HIGH);
 
     //Init the LUFA USB Device Library
+    XidSetPersonality(eeprom_read_byte(&storedPersonality)); //Falls back to the default if it was never stored
     SetupHardware();
     GlobalInterruptEnable();
 
@@ -114,6 +258,13 @@ int main(void)
 
     //Init the XboxOG data arrays to zero.
     memset(&XboxOGDuke, 0x00, sizeof(USB_XboxGamepad_Data_t));
+    #ifdef SUPPORTBATTALION
+    memset(&XboxOGBattalion, 0x00, sizeof(USB_XboxSteelBattalion_Data_t));
+    battalionReset(&battalion);
+    #ifdef ENABLE_BATTALION_KEYBOARD
+    Keyboard.SetReportParser(0, &battalionKeys);
+    #endif
+    #endif
 
     digitalWrite(USB_HOST_RESET_PIN, LOW);
     delay(20); //wait 20ms to reset the IC. Reseting at startup improves reliability in my experience.
@@ -136,438 +287,463 @@ int main(void)
     #ifdef ENABLE_MOTION
     applyMotionSensitivity();
     #endif
+    #ifdef ENABLE_STICK_CURVE
+    stickCurveLoad(&stickCurve, stickProfile);
+    #endif
+    hotkeyInit(&hotkeys, HOTKEYS, sizeof(HOTKEYS) / sizeof(Hotkey_t));
+    #ifdef ENABLE_TURBO
+    turboReset(&turbo);
+    #endif
 
+    #ifdef ENABLE_BENCHMARK
+    runBenchmark(); //Never returns
+    #endif
+
+    schedulerInit(TASKS, sizeof(TASKS) / sizeof(SchedulerTask_t));
     while (1)
     {
+        schedulerRun();
+    }
+}
 
-        UsbHost.busprobe();
-        UsbHost.Task();
+//Poll the USB host controller and the connected controller's driver.
+void taskUsbHost()
+{
+    UsbHost.busprobe();
+    UsbHost.Task();
+    #ifdef ENABLE_TELEMETRY
+    telemetryHostState(UsbHost.getUsbTaskState());
+    #endif
+}
 
-        checkControllerChange();
-        if (controllerType)
-        {
-        
-            //Read Digital Buttons
-            XboxOGDuke.dButtons=0x0000;
-            if (getButtonPress(UP))      XboxOGDuke.dButtons |= DUP;
-            if (getButtonPress(DOWN))    XboxOGDuke.dButtons |= DDOWN;
-            if (getButtonPress(LEFT))    XboxOGDuke.dButtons |= DLEFT;
-            if (getButtonPress(RIGHT))   XboxOGDuke.dButtons |= DRIGHT;;
-            if (getButtonPress(START))   XboxOGDuke.dButtons |= START_BTN;
-            if (getButtonPress(BACK))    XboxOGDuke.dButtons |= BACK_BTN;
-            if (getButtonPress(L3))      XboxOGDuke.dButtons |= LS_BTN;
-            if (getButtonPress(R3))      XboxOGDuke.dButtons |= RS_BTN;
-
-            //Read Analog Buttons - have to be converted to digital because x360 controllers don't have analog buttons
-            getButtonPress(A)    ? XboxOGDuke.A = 0xFF      : XboxOGDuke.A = 0x00;
-            getButtonPress(B)    ? XboxOGDuke.B = 0xFF      : XboxOGDuke.B = 0x00;
-            getButtonPress(X)    ? XboxOGDuke.X = 0xFF      : XboxOGDuke.X = 0x00;
-            getButtonPress(Y)    ? XboxOGDuke.Y = 0xFF      : XboxOGDuke.Y = 0x00;
-            getButtonPress(L1)   ? XboxOGDuke.WHITE = 0xFF  : XboxOGDuke.WHITE = 0x00;
-            getButtonPress(R1)   ? XboxOGDuke.BLACK = 0xFF  : XboxOGDuke.BLACK = 0x00;
-
-            //Read Analog triggers
-            XboxOGDuke.L = getButtonPress(L2); //0x00 to 0xFF
-            XboxOGDuke.R = getButtonPress(R2); //0x00 to 0xFF
-
-            //Read Control Sticks (16bit signed short)
-            XboxOGDuke.leftStickX = getAnalogHat(LeftHatX);
-            XboxOGDuke.leftStickY = getAnalogHat(LeftHatY);
-            XboxOGDuke.rightStickX = getAnalogHat(RightHatX);
-            XboxOGDuke.rightStickY = getAnalogHat(RightHatY);
-            
-            #ifdef ENABLE_MOTION
-            if (motionOn) {
-                if (controllerType == 3 || controllerType == 4) {
-                // Assigns values to rollAngle and pitchAngle
-                rollAngle = getMotion(Roll);
-                pitchAngle = getMotion(Pitch);
-                rollAngle = limitValue(rollAngle, maxInputAngle, minInputAngle);
-                pitchAngle = limitValue(pitchAngle, maxInputAngle, minInputAngle);
-                relativeRollAngle = rollAngle - 180; // Makes angle zero-relative
-                relativePitchAngle = pitchAngle - 180;
-
-                lookXAdjust_f = (float)relativeRollAngle / sensitivityAngle; // A proportion of the maximum
-			    lookYAdjust_f = (float)relativePitchAngle / sensitivityAngle;
-
-                // TO DO - allow user to invert motion y axis
-                if (controllerType == 3) {
-                    lookYAdjust_f = lookYAdjust_f * -1;
-                } else if (controllerType == 4) {
-                    lookXAdjust_f = lookXAdjust_f * -1;
-                    lookYAdjust_f = lookYAdjust_f * -1;
-                }
-
-                totalX = XboxOGDuke.rightStickX + (lookXAdjust_f * 32767);
-                totalY = XboxOGDuke.rightStickY + (lookYAdjust_f * 32767);
-
-                totalX = limitValue(totalX, 32767, -32767);
-                totalY = limitValue(totalY, 32767, -32767);
-
-                XboxOGDuke.rightStickX = totalX;
-                XboxOGDuke.rightStickY = totalY;
-
-                }
-            }
-            #endif
-           
-            //Anything that sends a command to the Xbox 360 controllers happens here.
-            //(i.e rumble, LED changes, controller off command)
-            static uint32_t commandTimer = 0;
-            static uint32_t xboxHoldTimer = 0;
-            if (millis() - commandTimer > 16)
-            {
-                // Enable motion controls
-                // TO DO - only turn on motion when compatible controller connected
-                if (getButtonPress(XBOX) && getButtonPress(R2) > 0x00)
-                {
-                    if (xboxHoldTimer == 0)
-                    {
-                        xboxHoldTimer = millis();
-                    }
-                    if ((millis() - xboxHoldTimer) > 1000 && (millis() - xboxHoldTimer) < 1100)
-                    {
-
-                        xboxHoldTimer = 0;
-                        #ifdef ENABLE_MOTION
-                        motionOn = !motionOn;
-                        #endif
-                        #ifdef ENABLE_OLED
-                        updateOled();
-                        #endif
-                    }
-                }
-                else if (getButtonPress(XBOX) && getButtonPress(R1) > 0x00)
-                {
-                    if (xboxHoldTimer == 0)
-                    {
-                        xboxHoldTimer = millis();
-                    }
-                    if ((millis() - xboxHoldTimer) > 1000 && (millis() - xboxHoldTimer) < 1100)
-                    {
-
-                        xboxHoldTimer = 0;
-                        #ifdef ENABLE_MOTION
-                        changeMotionSensitivity();
-                        #endif
-                        #ifdef ENABLE_OLED
-                        updateOled();
-                        #endif
-                    }
-                }
-                // Enable rumble
-                else if (getButtonPress(XBOX) && getButtonPress(L2) > 0x00)
-                {
-                    if (xboxHoldTimer == 0)
-                    {
-                        xboxHoldTimer = millis();
-                    }
-                    if ((millis() - xboxHoldTimer) > 1000 && (millis() - xboxHoldTimer) < 1100)
-                    {
-
-                        xboxHoldTimer = 0;
-                        #ifdef ENABLE_RUMBLE
-                        rumbleOn = !rumbleOn;
-                        #endif
-                        #ifdef ENABLE_OLED
-                        updateOled();
-                        #endif
-                    }
-                }
-                #ifdef ENABLE_RUMBLE
-                //START+BACK TRIGGERS is a standard soft reset command.
-                //We turn off the rumble motors here to prevent them getting locked on
-                //if you happen to press this reset combo mid rumble.
-                else if (getButtonPress(START) && getButtonPress(BACK) &&
-                            getButtonPress(L2) > 0x00 && getButtonPress(R2) > 0x00)
-                {       
-                    //Turn off rumble
-                    XboxOGDuke.left_actuator = 0;
-                    XboxOGDuke.right_actuator = 0;
-                    XboxOGDuke.rumbleUpdate = 1;
-                    
-                }
-                #endif
-                else
-                {   
-                    xboxHoldTimer = 0; //Reset the XBOX button hold time counter.
-                    #ifdef ENABLE_RUMBLE 
-                    if (XboxOGDuke.rumbleUpdate == 1)
-                    {   
-                        setRumbleOn(XboxOGDuke.left_actuator, XboxOGDuke.right_actuator);
-                        XboxOGDuke.rumbleUpdate = 0;
-                    }
-                    #endif
-                }
-                commandTimer = millis();
-            }
+//Map a new controller report into the Duke report, and run any hotkeys that are due.
+void taskInput()
+{
+    checkControllerChange();
+    if (!controllerType)
+        return;
 
-            sendControllerHIDReport();
-        }
+    #ifdef ENABLE_BATTALION_KEYBOARD
+    if (battalionKeys.changes() != mappedKeysSeq)
+    {
+        mappedKeysSeq = battalionKeys.changes();
+        remapReport = true;
+    }
+    #endif
 
+    //Only rebuild the report when the driver has parsed a new report
+    uint16_t reportSeq = controller.reportSeq();
+    if (remapReport || reportSeq != mappedReportSeq)
+    {
+        mappedReportSeq = reportSeq;
+        remapReport = false;
 
-        //Handle Player 1 controller connect/disconnect events.
-        if (controllerConnected() && disconnectTimer == 0)
-        {
-            USB_Attach();
-            if (enumerationComplete)
-            {
-                digitalWrite(ARDUINO_LED_PIN, LOW);
-            }
-        }
-        else if (millis() > 7000)
-        {
-            digitalWrite(ARDUINO_LED_PIN, HIGH);
-            USB_Detach(); //Disconnect from the OG Xbox port.
-        }
+        readInputSnapshot(&input);
+        hotkeyInput(&hotkeys, hotkeyChord(&input), millis());
+        #ifdef ENABLE_STICK_CAL
+        stickCalApply(&stickCal, &input, millis());
+        #endif
+        #ifdef ENABLE_STICK_FILTER
+        input.leftStickX = stickFilterAxis(&stickFilter[0], input.leftStickX);
+        input.leftStickY = stickFilterAxis(&stickFilter[1], input.leftStickY);
+        input.rightStickX = stickFilterAxis(&stickFilter[2], input.rightStickX);
+        input.rightStickY = stickFilterAxis(&stickFilter[3], input.rightStickY);
+        #endif
+        #ifdef ENABLE_STICK_CURVE
+        stickCurveApply(&stickCurve, &input.leftStickX, &input.leftStickY);
+        stickCurveApply(&stickCurve, &input.rightStickX, &input.rightStickY);
+        #endif
+
+        #ifdef SUPPORTBATTALION
+        if (ConnectedXID == STEELBATTALION)
+            mapBattalionReport();
         else
-        {
-            USB_Attach();
-            sendControllerHIDReport();
-        }
+        #endif
+            mapDukeReport();
+    }
+
+    //Hotkeys whose hold time has passed
+    hotkeyTask(&hotkeys, millis());
+}
+
+//Build the Duke report from the input snapshot.
+void mapDukeReport()
+{
+    uint8_t previous[DUKE_INPUT_SIZE];
+    memcpy(previous, &XboxOGDuke.dButtons, DUKE_INPUT_SIZE);
+
+    //Turbo, if enabled, is applied on top of these when the report is sent
+    setDukeButtons(input.buttons);
 
+    //Analog triggers
+    XboxOGDuke.L = input.leftTrigger;
+    XboxOGDuke.R = input.rightTrigger;
 
-        //THPS 2X is the only game I know that sends rumble commands to the USB OUT pipe
-        //instead of the control pipe. So unfortunately need to manually read the out pipe
-        //and update rumble values as needed!
-        // uint8_t ep = Endpoint_GetCurrentEndpoint();
-        // static uint8_t report[6];
-        // Endpoint_SelectEndpoint(0x02); //0x02 is the out endpoint address for the Duke Controller
-        // if (Endpoint_IsOUTReceived())
-        // {
-        //     Endpoint_Read_Stream_LE(report, 6, NULL);
-        //     Endpoint_ClearOUT();
-        //     if (report[1] == 0x06)
-        //     {
-        //         XboxOGDuke.left_actuator = report[3];
-        //         XboxOGDuke.right_actuator = report[5];
-        //         XboxOGDuke.rumbleUpdate = 1;
-        //     }
-        //     report[1] = 0x00;
-        // }
-        // Endpoint_SelectEndpoint(ep); //set back to the old endpoint.
+    //Control Sticks (16bit signed short)
+    XboxOGDuke.leftStickX = input.leftStickX;
+    XboxOGDuke.leftStickY = input.leftStickY;
+    XboxOGDuke.rightStickX = input.rightStickX;
+    XboxOGDuke.rightStickY = input.rightStickY;
 
+    #ifdef ENABLE_MOTION
+    if (input.hasMotion && motionMode == MOTION_TILT) {
+        XboxOGDuke.rightStickX = applyMotion(XboxOGDuke.rightStickX, input.roll);
+        XboxOGDuke.rightStickY = applyMotion(XboxOGDuke.rightStickY, input.pitch);
+    }
+    #ifdef ENABLE_GYRO
+    else if (input.hasMotion && motionMode == MOTION_GYRO) {
+        applyGyro(&input);
     }
+    #endif
+    #endif
+
+    //Jitter filtered out or a report with nothing new, don't wake the HID task
+    if (memcmp(previous, &XboxOGDuke.dButtons, DUKE_INPUT_SIZE))
+        dukeReportDirty = true;
 }
 
-/* Send the HID report to the OG Xbox */
-void sendControllerHIDReport()
+#ifdef SUPPORTBATTALION
+//Build the Steel Battalion report from the input snapshot and the keyboard, see battalion.h.
+void mapBattalionReport()
+{
+    const BattalionKeys_t *keys = NULL;
+    #ifdef ENABLE_BATTALION_KEYBOARD
+    keys = battalionKeys.keys();
+    #endif
+    if (battalionMap(&battalion, &input, keys, &XboxOGBattalion))
+        dukeReportDirty = true;
+}
+#endif
+
+//Anything that sends a command to the Xbox 360 controllers happens here.
+//(i.e rumble, LED changes, controller off command)
+void taskCommands()
 {
-    if (USB_Device_GetFrameNumber() - DukeController_HID_Interface.State.PrevFrameNum >= 4)
+    #ifdef ENABLE_STICK_CAL
+    stickCalFlush(&stickCal); //Also after a disconnect, to finish saving what was learnt
+    #endif
+    if (!controllerType)
+        return;
+    #ifdef ENABLE_RUMBLE
+    uint8_t left, right;
+    if (DukeReadRumble(&left, &right, &rumbleSeen))
     {
-        HID_Device_USBTask(&DukeController_HID_Interface); //Send OG Xbox HID Report
+        XboxOGDuke.left_actuator = left;
+        XboxOGDuke.right_actuator = right;
+        XboxOGDuke.rumbleUpdate = 1;
     }
-    USB_USBTask();
+    //Hold off while a hotkey is held, so the stop rumble combo isn't undone
+    if (!hotkeyActive(&hotkeys) && XboxOGDuke.rumbleUpdate == 1)
+    {
+        setRumbleOn(XboxOGDuke.left_actuator, XboxOGDuke.right_actuator);
+        XboxOGDuke.rumbleUpdate = 0;
+    }
+    #endif
 }
 
-// TO DO - remove the separate controller connected checks in these functions
-//Parse button presses for each type of controller
-uint8_t getButtonPress(ButtonEnum b)
+//Handle Player 1 controller connect/disconnect events.
+void taskAttach()
 {
+    #ifdef ENABLE_TELEMETRY
+    telemetryUpdate();
+    #endif
 
-    uint8_t psVal = 0;
-
-
-    if (Xbox360Wired.Xbox360Connected)
-        return Xbox360Wired.getButtonPress(b);
+    //Stay detached for a moment after switching XID personality, so the console notices
+    if (disconnectTimer != 0)
+    {
+        if (millis() - disconnectTimer < XID_DETACH_MS)
+            return;
+        disconnectTimer = 0;
+    }
 
-    if (XboxOneWired.XboxOneConnected)
+    if (controllerType)
     {
-        if (b == L2 || b == R2)
+        USB_Attach();
+        if (enumerationComplete)
         {
-            //Xbone one triggers are 10-bit, remove 2LSBs so its 8bit like OG Xbox
-            return (uint8_t)(XboxOneWired.getButtonPress(b) >> 2); 
-        }
-        else
-        {
-            return (uint8_t)XboxOneWired.getButtonPress(b);
+            digitalWrite(ARDUINO_LED_PIN, LOW);
         }
     }
+    else if (millis() > 7000)
+    {
+        digitalWrite(ARDUINO_LED_PIN, HIGH);
+        USB_Detach(); //Disconnect from the OG Xbox port.
+    }
+    else
+    {
+        USB_Attach();
+    }
+}
 
-    if (PS3Wired.PS3Connected) {
-		switch (b) {
-			// Remap the PS3 controller face buttons to their Xbox counterparts
-			case A:
-				psVal = (uint8_t)PS3Wired.getButtonPress(CROSS); // TO DO - are these casts needed now? And in PS4 code.
-				break;
-			case B:
-				psVal = (uint8_t)PS3Wired.getButtonPress(CIRCLE);
-				break;
-			case X:
-				psVal = (uint8_t)PS3Wired.getButtonPress(SQUARE);
-				break;
-			case Y:
-				psVal = (uint8_t)PS3Wired.getButtonPress(TRIANGLE);
-				break;
-			// Call a different function from the PS3USB library to get the level of
-			// pressure applied to the L2 and R2 triggers, not just 'on' or 'off
-			case L2:
-				psVal = (uint8_t)PS3Wired.getAnalogButton(L2);
-				break;
-			case R2:
-				psVal = (uint8_t)PS3Wired.getAnalogButton(R2);
-				break;
-			// Requests for the start, select, R1, L1 and the D-pad buttons can be called normally
-			default:
-				psVal = (uint8_t)PS3Wired.getButtonPress(b);
-		}
-		return psVal;
-	}
-
-	if (PS4Wired.connected()) {
-		switch (b) {
-			// Remap the PS4 controller face buttons to their Xbox counterparts
-			case A:
-				psVal = (uint8_t)PS4Wired.getButtonPress(CROSS);
-				break;
-			case B:
-				psVal = (uint8_t)PS4Wired.getButtonPress(CIRCLE);
-				break;
-			case X:
-				psVal = (uint8_t)PS4Wired.getButtonPress(SQUARE);
-				break;
-			case Y:
-				psVal = (uint8_t)PS4Wired.getButtonPress(TRIANGLE);
-				break;
-			// Call a different function from the PS4USB library to get the level of
-			// pressure applied to the L2 and R2 triggers, not just 'on' or 'off
-			case L2:
-				psVal = (uint8_t)PS4Wired.getAnalogButton(L2);
-				break;
-			case R2:
-				psVal = (uint8_t)PS4Wired.getAnalogButton(R2);
-				break;
-			default:
-				psVal = (uint8_t)PS4Wired.getButtonPress(b);
-		}
-		return psVal;
-	}
-
-    return 0;
+#ifdef ENABLE_OLED
+//Redraw the OLED when something shown on it has changed. Slow, so it is left until nothing more urgent is due.
+void taskOled()
+{
+    if (!oledDirty)
+        return;
+    oledDirty = false;
+    updateOled();
 }
+#endif
 
-//Parse analog stick requests for each type of controller.
-int16_t getAnalogHat(AnalogHatEnum a)
+/* Send the HID report to the OG Xbox */
+void sendControllerHIDReport()
 {
+    uint16_t frame = USB_Device_GetFrameNumber();
+    #ifdef SUPPORTBATTALION
+    if (ConnectedXID == STEELBATTALION)
+        sendBattalionReport(frame);
+    else
+    #endif
+        sendDukeReport(frame);
+    #ifndef INTERRUPT_CONTROL_ENDPOINT
+    USB_USBTask();
+    #endif
+}
 
-    if (Xbox360Wired.Xbox360Connected)
+//A changed report goes out at most once a frame and replaces one the console hasn't read yet.
+//An unchanged one is only repeated if the console asked for that (SET_IDLE) and the period is up
+bool xidReportDue(USB_ClassInfo_HID_Device_State_t *state, uint16_t frame, uint8_t interval)
+{
+    if (frame == state->PrevFrameNum)
+        return false;
+    if (dukeReportDirty)
+        return true;
+    bool idleElapsed;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) //Changed from interrupts
     {
-        int16_t val;
-        val = Xbox360Wired.getAnalogHat(a);
-        if (val == -32512) //8bitdo range fix
-            val = -32768;
-        return val;
+        idleElapsed = state->IdleCount && !state->IdleMSRemaining;
     }
+    return idleElapsed && frame - state->PrevFrameNum >= interval;
+}
 
-    if (XboxOneWired.XboxOneConnected)
-        return XboxOneWired.getAnalogHat(a);
-
-    if (PS3Wired.PS3Connected) {
-		// Scale up the unsigned 8bit values produced by the PS3 analog sticks to the
-		// signed 16bit values expected by the Xbox. In the case of the Y axes, invert the result
-		if (a == RightHatY || a == LeftHatY) {
-			return (PS3Wired.getAnalogHat(a) - 127) * -255;
-		} else {
-			return (PS3Wired.getAnalogHat(a) - 127) * 255;
-		}
-	}
-
-	if (PS4Wired.connected()) {
-		if (a == RightHatY || a == LeftHatY) {
-			return (PS4Wired.getAnalogHat(a) - 127) * -255;
-		} else {
-			return (PS4Wired.getAnalogHat(a) - 127) * 255;
-		}
-	}
+void sendDukeReport(uint16_t frame)
+{
+    #ifdef ENABLE_TURBO
+    //Turbo buttons follow the frame the report goes out in
+    if (controllerType && turboActive(&turbo))
+        setDukeButtons(turboApply(&turbo, input.buttons, frame));
+    #endif
 
-    return 0;
+    #ifdef ENABLE_SOF_REPORTS
+    //The SOF interrupt sends whatever was published last
+    if (dukeReportDirty)
+    {
+        DukePublishInput(&XboxOGDuke);
+        dukeReportDirty = false;
+    }
+    #else
+    if (xidReportDue(&DukeController_HID_Interface.State, frame, DUKE_POLL_INTERVAL_MS))
+    {
+        if (dukeReportDirty)
+            DukePublishInput(&XboxOGDuke);
+        if (DukeSendReport()) //Send OG Xbox HID Report
+            dukeReportDirty = false;
+    }
+    #endif
 }
 
-#ifdef ENABLE_RUMBLE
-//Parse rumble activation requests for each type of controller.
-void setRumbleOn(uint8_t lValue, uint8_t rValue)
+#ifdef SUPPORTBATTALION
+//Always from the main loop, the Battalion is polled every 4ms and has no SOF path
+void sendBattalionReport(uint16_t frame)
 {
-    if (rumbleOn) {
-        if (Xbox360Wired.Xbox360Connected)
-        {
-            Xbox360Wired.setRumbleOn(lValue, rValue); 
-        }
+    if (xidReportDue(&SteelBattalion_HID_Interface.State, frame, BATTALION_POLL_INTERVAL_MS))
+    {
+        if (dukeReportDirty)
+            BattalionPublishInput(&XboxOGBattalion);
+        if (BattalionSendReport())
+            dukeReportDirty = false;
+    }
+}
+#endif
 
-        if (XboxOneWired.XboxOneConnected)
-        {
-            XboxOneWired.setRumbleOn(lValue / 8, rValue / 8, lValue / 2, rValue / 2);
-        }
+//Set the digital and analog buttons of the Duke report from IN_* bits.
+void setDukeButtons(uint16_t buttons)
+{
+    if (buttons == dukeButtons)
+        return;
+    dukeButtons = buttons;
+    dukeReportDirty = true;
+
+    //Digital buttons share the snapshot layout
+    XboxOGDuke.dButtons = (uint8_t)buttons;
+
+    //Analog Buttons - have to be converted to digital because x360 controllers don't have analog buttons
+    XboxOGDuke.A = (buttons & IN_A) ? 0xFF : 0x00;
+    XboxOGDuke.B = (buttons & IN_B) ? 0xFF : 0x00;
+    XboxOGDuke.X = (buttons & IN_X) ? 0xFF : 0x00;
+    XboxOGDuke.Y = (buttons & IN_Y) ? 0xFF : 0x00;
+    XboxOGDuke.WHITE = (buttons & IN_WHITE) ? 0xFF : 0x00;
+    XboxOGDuke.BLACK = (buttons & IN_BLACK) ? 0xFF : 0x00;
+}
 
-        // TO DO - add left and right values
-        // TO DO - consider separate rumbleOff function
-        if (PS3Wired.PS3Connected)
-        {   
-            if (lValue == 0 && rValue == 0) {
-                PS3Wired.setRumbleOff();
-            } else {
-                PS3Wired.setRumbleOn(RumbleLow);
-            }
-        }
+//Fill the snapshot from the connected controller. Only called when a new report has arrived.
+void readInputSnapshot(InputSnapshot_t *in)
+{
+    controller.read(in);
+    #ifdef ENABLE_MOTION
+    if (motionMode != MOTION_OFF && controller.hasMotion)
+        controller.readMotion(in);
+    #endif
+}
 
-        if (PS4Wired.connected())
-        {   
-            if (lValue == 0 && rValue == 0) {
-                PS4Wired.setRumbleOff();
-            } else {
-                PS4Wired.setRumbleOn(RumbleLow);
-            }
-        }
-    }
+#ifdef ENABLE_RUMBLE
+//Pass rumble requests on to the connected controller.
+void setRumbleOn(uint8_t lValue, uint8_t rValue)
+{
+    if (rumbleOn && controllerType)
+        controller.setRumble(lValue, rValue);
 }
 #endif
 
-//Parse LED activation requests for each type of controller.
+//Pass LED requests on to the connected controller.
 void setLedOn(LEDEnum led)
 {
+    if (controllerType)
+        controller.setLed(led);
+}
 
-    if (Xbox360Wired.Xbox360Connected)
-        Xbox360Wired.setLedOn(led);
-
-    if (XboxOneWired.XboxOneConnected)
+//Returns the position of the connected controller in CONTROLLERS[] plus one, or 0 if there isn't one.
+uint8_t controllerConnected()
+{
+    for (uint8_t i = 0; i < CONTROLLER_COUNT; i++)
     {
-        //no LEDs on Xbox One Controller. I think it is possible to adjust brightness but this is not implemented.
+        bool (*connected)() = (bool (*)())pgm_read_ptr(&CONTROLLERS[i].connected);
+        if (connected())
+            return i + 1;
     }
+    return 0;
+}
 
-    if (PS3Wired.PS3Connected)
-	PS3Wired.setLedOn(led);
+//Hotkey actions, see HOTKEYS[]
+#ifdef ENABLE_MOTION
+void hotkeyMotionMode()
+{
+    changeMotionMode();
+    remapReport = true;
+    #ifdef ENABLE_OLED
+    oledDirty = true;
+    #endif
+}
 
-    // if (PS3Wired.PS3Connected)
-	// PS3Wired.setLedOn(led);
+void hotkeyMotionSensitivity()
+{
+    changeMotionSensitivity();
+    applyMotionSensitivity();
+    remapReport = true;
+    #ifdef ENABLE_OLED
+    oledDirty = true;
+    #endif
+}
+#endif
 
+#ifdef ENABLE_STICK_CURVE
+void hotkeyStickProfile()
+{
+    changeStickProfile();
+    remapReport = true;
+    #ifdef ENABLE_OLED
+    oledDirty = true;
+    #endif
 }
+#endif
 
+//Present the next XID personality (Duke, Controller S, Steel Battalion) to the console and remember it
+void hotkeyPersonality()
+{
+    uint8_t next = XidPersonality + 1;
+    if (next >= XID_PERSONALITY_COUNT)
+        next = XID_DUKE;
+    XidSetPersonality(next);
+    eeprom_update_byte(&storedPersonality, next);
+    #ifdef SUPPORTBATTALION
+    battalionReset(&battalion);
+    #endif
+    remapReport = true; //Build the report of the new personality
+    disconnectTimer = millis() | 1; //Never 0, taskAttach() attaches again after XID_DETACH_MS
+}
 
-// TO DO - merge these two functions
-uint8_t controllerConnected()
+#ifdef ENABLE_RUMBLE
+void hotkeyRumble()
 {
-    uint8_t controllerType = 0;
+    rumbleOn = !rumbleOn;
+    #ifdef ENABLE_OLED
+    oledDirty = true;
+    #endif
+}
 
-    if (Xbox360Wired.Xbox360Connected)
-        controllerType =  1;
+//Turn off the rumble motors so they don't get locked on
+//if you happen to press the reset combo mid rumble.
+void hotkeyStopRumble()
+{
+    XboxOGDuke.left_actuator = 0;
+    XboxOGDuke.right_actuator = 0;
+    XboxOGDuke.rumbleUpdate = 1;
+}
+#endif
 
-    if (XboxOneWired.XboxOneConnected)
-        controllerType =  2;
+#ifdef ENABLE_TURBO
+//XBOX+face button cycles that button through turbo rates and auto fire
+void hotkeyTurboA() { changeTurbo(IN_A); }
+void hotkeyTurboB() { changeTurbo(IN_B); }
+void hotkeyTurboX() { changeTurbo(IN_X); }
+void hotkeyTurboY() { changeTurbo(IN_Y); }
 
-    if (PS3Wired.PS3Connected)
-		controllerType =  3;
+void changeTurbo(uint16_t button)
+{
+    turboCycle(&turbo, button);
+    remapReport = true;
+    #ifdef ENABLE_OLED
+    oledDirty = true;
+    #endif
+}
+#endif
 
-	if (PS4Wired.connected())
-		controllerType =  4;
+#ifdef ENABLE_STICK_CURVE
+//Raw -> Linear -> Quad -> S-curve -> Anti-DZ -> Raw
+void changeStickProfile()
+{
+    if (++stickProfile >= STICK_PROFILE_COUNT)
+        stickProfile = STICK_PROFILE_BYPASS;
+    stickCurveLoad(&stickCurve, stickProfile);
+}
+#endif
 
-    return controllerType;
+#ifdef ENABLE_STICK_FILTER
+void resetStickFilter()
+{
+    int16_t hold = controllerType && controller.stick8Bit ? STICK_FILTER_HOLD_8BIT : STICK_FILTER_HOLD_16BIT;
+    for (uint8_t i = 0; i < 4; i++)
+        stickFilterReset(&stickFilter[i], 0, hold);
 }
+#endif
 
+//Select the adapter for the connected controller, once, when it changes.
 void checkControllerChange() {
     uint8_t currentController = controllerConnected();
     if (currentController != controllerType) {
         controllerType = currentController;
+        #ifdef ENABLE_GYRO
+        gyroAxisReset(&gyroYaw);
+        gyroAxisReset(&gyroPitch);
+        #endif
+        hotkeyReset(&hotkeys);
+        if (controllerType) {
+            memcpy_P(&controller, &CONTROLLERS[controllerType - 1], sizeof(ControllerOps_t));
+            #ifdef ENABLE_STICK_CAL
+            uint32_t id = controller.deviceId();
+            stickCalLoad(&stickCal, id >> 16, id & 0xFFFF, millis());
+            #endif
+            #ifdef ENABLE_TELEMETRY
+            telemetryHostConnected();
+            #endif
+        }
+        #ifdef ENABLE_STICK_FILTER
+        resetStickFilter();
+        #endif
+        remapReport = true;
         #ifdef ENABLE_OLED
-        updateOled();
+        oledDirty = true;
         #endif
     }
 }
@@ -585,9 +761,9 @@ void updateOled() {
     #endif
     #ifdef ENABLE_MOTION
     oled.print("Motion ");
-    if (controllerType == 3 || controllerType == 4) {
-        if (motionOn == true) {
-            oled.print("On, ");
+    if (controllerType && controller.hasMotion) {
+        if (motionMode != MOTION_OFF) {
+            oled.print(motionMode == MOTION_GYRO ? "Gyro, " : "Tilt, ");
             if (motionSensitivity == 0) {
                 oled.println("Low");
             } else if (motionSensitivity == 1) {
@@ -602,6 +778,28 @@ void updateOled() {
         oled.println("N/A");
     }
     #endif
+    #ifdef ENABLE_STICK_CURVE
+    oled.print("Sticks ");
+    oled.println((const __FlashStringHelper *)pgm_read_ptr(&STICK_PROFILES[stickProfile].name));
+    #endif
+    #ifdef ENABLE_TURBO
+    //Each face button with turbo followed by its rate, 1 is fastest, * is auto fire
+    oled.print("Turbo");
+    if (turboActive(&turbo)) {
+        const uint16_t buttons[] = {IN_A, IN_B, IN_X, IN_Y};
+        for (uint8_t i = 0; i < 4; i++) {
+            uint8_t mode = turboMode(&turbo, buttons[i]);
+            if (mode == TURBO_OFF)
+                continue;
+            oled.print(' ');
+            oled.print("ABXY"[i]);
+            oled.print(mode == TURBO_AUTO ? '*' : (char)('0' + mode));
+        }
+        oled.println();
+    } else {
+        oled.println(" Off");
+    }
+    #endif
     // getStatus();
     // oled.println(status);
 }
@@ -626,17 +824,6 @@ void updateOled() {
 
 #ifdef ENABLE_MOTION
 
-// TO DO - could these casts to ints conceivably return a value > 360? Is that a problem?
-
-int16_t getMotion(AngleEnum a) {
-    if (controllerType == 3) {
-        return (int16_t)PS3Wired.getAngle(a);     
-    } else if (controllerType == 4) {
-        return (int16_t)PS4Wired.getAngle(a);      
-    }
-    return 0;
-}
-
 int16_t limitValue(int32_t value, int32_t maxVal, int32_t minVal) {
     if (value > maxVal) { return maxVal; }
     else if (value < minVal) { return minVal; }
@@ -659,8 +846,60 @@ void applyMotionSensitivity() {
     } else {
         sensitivityAngle = 30;
     }
-    maxInputAngle = 180 + sensitivityAngle; // e.g. 180 + 45 = 225
-    minInputAngle = 180 - sensitivityAngle; // e.g. 180 - 45 = 135
+    maxInputAngle = (180 + sensitivityAngle) * ANGLE_SCALE; // e.g. 180 + 45 = 225 degrees
+    minInputAngle = (180 - sensitivityAngle) * ANGLE_SCALE; // e.g. 180 - 45 = 135 degrees
+    //Full tilt (sensitivityAngle degrees) moves the stick by 32767
+    motionGain = (32767L * 256) / (sensitivityAngle * ANGLE_SCALE);
+    #ifdef ENABLE_GYRO
+    //Turning at 4 x sensitivityAngle degree/s moves the stick by 32767, e.g. 180 degree/s on Med
+    gyroGain = (32767L * 256) / (4 * sensitivityAngle * 16);
+    #endif
+}
+
+//Off -> Tilt -> Gyro -> Off, or Off -> Tilt -> Off without ENABLE_GYRO
+void changeMotionMode() {
+    #ifdef ENABLE_GYRO
+    uint8_t lastMode = MOTION_GYRO;
+    #else
+    uint8_t lastMode = MOTION_TILT;
+    #endif
+    if (motionMode < lastMode) {
+        ++motionMode;
+    } else {
+        motionMode = MOTION_OFF;
+    }
+    #ifdef ENABLE_GYRO
+    if (motionMode == MOTION_GYRO) {
+        gyroAxisReset(&gyroYaw);
+        gyroAxisReset(&gyroPitch);
+        gyroTime = millis();
+    }
+    #endif
+}
+
+#ifdef ENABLE_GYRO
+//Add the turning rate of the controller to the right stick.
+void applyGyro(const InputSnapshot_t *in)
+{
+    uint32_t now = millis();
+    uint32_t elapsed = now - gyroTime;
+    uint8_t dt = elapsed > 32 ? 32 : elapsed; // Don't let a gap between reports throw the filter
+    gyroTime = now;
+
+    if (in->gyroAxes & GYRO_AXIS_YAW)
+        XboxOGDuke.rightStickX = gyroToStick(XboxOGDuke.rightStickX, gyroAxisRate(&gyroYaw, in->gyroYaw), gyroGain);
+    if (in->gyroAxes & GYRO_AXIS_PITCH)
+        XboxOGDuke.rightStickY = gyroToStick(XboxOGDuke.rightStickY, gyroAxisRate(&gyroPitch, in->gyroPitch, in->pitch, dt), gyroGain);
+}
+#endif
+
+//Add the tilt of the controller to a stick axis. angle is in 1/16 degree steps, 180 degrees is level.
+//Integer only, this runs for every report while motion aiming is on.
+int16_t applyMotion(int16_t stick, uint16_t angle)
+{
+    int16_t relative = limitValue(angle, maxInputAngle, minInputAngle) - ANGLE_180; // Makes angle zero-relative
+    int32_t total = stick + (((int32_t)relative * motionGain + 128) >> 8);
+    return limitValue(total, 32767, -32767);
 }
 
 #endif
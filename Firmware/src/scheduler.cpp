@@ -0,0 +1,98 @@
+/*
+ * scheduler.cpp
+ *
+ * See scheduler.h.
+ */
+
+#include "scheduler.h"
+#include <Arduino.h>
+
+static const SchedulerTask_t *taskTable; //PROGMEM
+static uint8_t taskCount;
+static SchedulerStats_t stats[SCHEDULER_MAX_TASKS];
+#ifdef ENABLE_SCHEDULER_STATS
+static uint32_t histogram[SCHEDULER_HISTOGRAM_BUCKETS];
+#endif
+
+//tasks is a PROGMEM table of up to SCHEDULER_MAX_TASKS tasks, in priority order for equal deadlines.
+void schedulerInit(const SchedulerTask_t *tasks, uint8_t count)
+{
+    taskTable = tasks;
+    taskCount = count > SCHEDULER_MAX_TASKS ? SCHEDULER_MAX_TASKS : count;
+    uint32_t now = micros();
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+        memset(&stats[i], 0x00, sizeof(SchedulerStats_t));
+        stats[i].release = now;
+    }
+}
+
+//Run the due task with the nearest deadline. Returns false if nothing was due.
+bool schedulerRun()
+{
+    uint32_t now = micros();
+    uint8_t next = taskCount;
+    int32_t nearest = 0;
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+        if ((int32_t)(now - stats[i].release) < 0)
+            continue;
+        //Time left until the deadline, negative once it has passed
+        int32_t left = (int32_t)(stats[i].release + pgm_read_dword(&taskTable[i].deadline) - now);
+        if (next == taskCount || left < nearest)
+        {
+            next = i;
+            nearest = left;
+        }
+    }
+    if (next == taskCount)
+        return false;
+
+    const SchedulerTask_t *task = &taskTable[next];
+    SchedulerStats_t *s = &stats[next];
+    void (*run)() = (void (*)())pgm_read_ptr(&task->run);
+#ifdef ENABLE_SCHEDULER_STATS
+    uint32_t start = micros();
+#endif
+    run();
+    uint32_t end = micros();
+
+#ifdef ENABLE_SCHEDULER_STATS
+    uint32_t elapsed = end - start;
+    if (elapsed > s->longest)
+        s->longest = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+    if (elapsed > pgm_read_word(&task->budget) && s->overruns < 0xFFFF)
+        s->overruns++;
+    if ((int32_t)(end - (s->release + pgm_read_dword(&task->deadline))) > 0 && s->misses < 0xFFFF)
+        s->misses++;
+    uint8_t bucket = 0;
+    for (uint32_t limit = 64; bucket < SCHEDULER_HISTOGRAM_BUCKETS - 1 && elapsed >= limit; limit <<= 1)
+        bucket++;
+    histogram[bucket]++;
+#endif
+
+    //A task that fell more than a period behind starts again from now, rather than running back to back to catch up
+    uint32_t period = pgm_read_dword(&task->period);
+    s->release += period;
+    if ((int32_t)(end - s->release) > (int32_t)period)
+        s->release = end;
+    return true;
+}
+
+#ifdef ENABLE_SCHEDULER_STATS
+const SchedulerStats_t *schedulerStats(uint8_t task)
+{
+    return &stats[task];
+}
+
+uint8_t schedulerTaskCount()
+{
+    return taskCount;
+}
+
+//Run times of all tasks, see SCHEDULER_HISTOGRAM_BUCKETS
+const uint32_t *schedulerHistogram()
+{
+    return histogram;
+}
+#endif
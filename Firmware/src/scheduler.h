@@ -0,0 +1,51 @@
+/*
+ * scheduler.h
+ *
+ * Cooperative earliest deadline first scheduler for the main loop. Each
+ * task runs every period microseconds and should finish within deadline
+ * microseconds of being released. Of the tasks that are due, the one
+ * whose deadline is nearest runs first, so a slow task delays the others
+ * by at most one run rather than a whole loop. Tasks run to completion.
+ *
+ * Budget is how long a task is expected to take. With ENABLE_SCHEDULER_STATS,
+ * runs over budget and deadlines missed are counted per task, along with
+ * the longest run, and a histogram of run times across all tasks shows how
+ * long the loop is held.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+#include "settings.h"
+
+typedef struct
+{
+    void (*run)();
+    uint32_t period;   //Microseconds between releases
+    uint32_t deadline; //Microseconds after its release the task should have finished by
+    uint16_t budget;   //Microseconds a run is expected to take
+} SchedulerTask_t;
+
+typedef struct
+{
+    uint32_t release;  //micros() the task is next due at
+#ifdef ENABLE_SCHEDULER_STATS
+    uint16_t overruns; //Runs that took longer than the budget
+    uint16_t misses;   //Runs that finished after the deadline
+    uint16_t longest;  //Longest run, microseconds
+#endif
+} SchedulerStats_t;
+
+#define SCHEDULER_MAX_TASKS 6 //Each costs 10 bytes of RAM, 4 without ENABLE_SCHEDULER_STATS
+#define SCHEDULER_HISTOGRAM_BUCKETS 8 //Runs under 64us, under 128us, ... under 4096us, and longer. The counts wrap
+
+void schedulerInit(const SchedulerTask_t *tasks, uint8_t count);
+bool schedulerRun();
+#ifdef ENABLE_SCHEDULER_STATS
+const SchedulerStats_t *schedulerStats(uint8_t task);
+uint8_t schedulerTaskCount();
+const uint32_t *schedulerHistogram();
+#endif
+
+#endif /* SCHEDULER_H_ */
@@ -19,7 +19,54 @@
 #define ENABLE_RUMBLE
 #define ENABLE_MOTION
 
+// Optional features. The OLED build was already at 98% of flash before these were added, so they
+// are off by default. Check "pio run -e MSTR -t size" still fits after enabling any of them
+// #define ENABLE_STICK_CAL    // Learns stick centre and range per controller model, see stickcal.h
+// #define ENABLE_STICK_FILTER // Smooths stick jitter around centre, see stickfilter.h
+// #define ENABLE_STICK_CURVE  // Deadzone and response curve profiles on XBOX+WHITE, see stickcurve.h
+// #define ENABLE_TURBO        // Turbo and auto fire on XBOX+A/B/X/Y, see turbo.h
+// #define ENABLE_GYRO         // Gyro aiming as a third motion mode, see gyroaim.h. Needs ENABLE_MOTION
+// #define ENABLE_SCHEDULER_STATS // Main loop task run times, overruns and misses, see scheduler.h
+// #define ENABLE_TELEMETRY    // Performance counters over USB for tools/telemetry.py, see telemetry.h
+
+#if defined(ENABLE_GYRO) && !defined(ENABLE_MOTION)
+#error "ENABLE_GYRO needs ENABLE_MOTION"
+#endif
+#if defined(ENABLE_TELEMETRY) && !defined(ENABLE_SCHEDULER_STATS)
+#error "ENABLE_TELEMETRY needs ENABLE_SCHEDULER_STATS"
+#endif
+
+// Steel Battalion emulation from a standard pad, one of the XID personalities. See battalion.h
+// The OLED build is close to full, so this needs room made, e.g. by disabling ENABLE_MOTION
+// #define SUPPORTBATTALION
+// Also map a USB keyboard onto the Battalion buttons the pad has no room for. The keyboard and
+// the controller connect through a USB hub, which needs the extra flash of the UHS hub driver
+// #define ENABLE_BATTALION_KEYBOARD
+
+#if defined(ENABLE_BATTALION_KEYBOARD) && !defined(SUPPORTBATTALION)
+#error "ENABLE_BATTALION_KEYBOARD needs SUPPORTBATTALION"
+#endif
+
+// How often the OG Xbox polls the controller, in ms. An original Duke uses 4.
+// 1 and 2 cut input latency on consoles and games that accept it. Must be 1, 2, 4 or 8.
+#define DUKE_POLL_INTERVAL_MS 4
+
+// Load the Duke report into the IN endpoint from the Start Of Frame interrupt, in the frame the
+// console is due to poll in, instead of from the main loop. Reports stay fresh while the main loop
+// is busy with the USB host. See DukeINStartOfFrame() in xiddriver.c
+// #define ENABLE_SOF_REPORTS
+
+// Count how old Duke reports are when the console reads them, and how many are replaced by newer
+// input before being read. See DukeReadINStats() in xiddriver.c. Off by default like the options above
+// #define ENABLE_LATENCY_STATS
+
+// Defined by the BENCH environment in platformio.ini, see benchmark.cpp
+// #define ENABLE_BENCHMARK
+
 /* prototypes */
 void sendControllerHIDReport();
+#ifdef ENABLE_BENCHMARK
+void runBenchmark();
+#endif
 
 #endif /* MAIN_H_ */
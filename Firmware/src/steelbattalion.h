@@ -7,6 +7,8 @@
 
 #ifndef STEELBATTALION_H_
 #define STEELBATTALION_H_
+#include "settings.h"
+#include "xiddriver.h"
 
 #ifdef SUPPORTBATTALION
 
@@ -54,23 +56,7 @@ https://github.com/Cxbx-Reloaded/Cxbx-Reloaded/blob/develop/src/core/hle/XAPI/Xa
 #define SBC_GAMEPAD_W2_TOGGLEBUFFREMATERIAL 0x0020
 #define SBC_GAMEPAD_W2_TOGGLEVTLOCATION 0x0040
 
-typedef struct
-{
-    uint8_t startByte;
-    uint8_t bLength;
-    uint16_t dButtons[3];
-    int16_t aimingX;
-    int16_t aimingY;
-    int16_t rotationLever;
-    int16_t sightChangeX;
-    int16_t sightChangeY;
-    uint16_t leftPedal;
-    uint16_t middlePedal;
-    uint16_t rightPedal;
-    int8_t tunerDial;
-    int8_t gearLever;
-
-} USB_XboxSteelBattalion_Data_t;
+//USB_XboxSteelBattalion_Data_t, the IN report, is in xiddriver.h
 
 typedef struct
 {
@@ -158,7 +144,7 @@ const uint8_t PROGMEM BATTALION_USB_DESCRIPTOR_CONFIGURATION[] = {
 
 //Obtained from USB analyser dump of original controller when talking to console
 //This is a custom vendor request specific to the xbox controller and an OG xbox.
-const uint8_t BATTALION_HID_DESCRIPTOR_XID[] = {
+const uint8_t PROGMEM BATTALION_HID_DESCRIPTOR_XID[] = {
     0x10,                                          //bLength - Length of report. 16 bytes
     0x42,                                          //bDescriptorType - always 0x42
     0x00, 0x01,                                    //bcdXid
@@ -173,7 +159,7 @@ const uint8_t BATTALION_HID_DESCRIPTOR_XID[] = {
 //If the bit is auto-generated, it will be cleared (0). Refer http://xboxdevwiki.net/Xbox_Input_Devices
 //Not sure if this is required but added it just in case.
 //Ive just guessed what it should be.
-const uint8_t BATTALION_HID_CAPABILITIES_IN[] = {
+const uint8_t PROGMEM BATTALION_HID_CAPABILITIES_IN[] = {
     0x00, //Always 0x00
     26,   //bLength - length of packet in bytes
     0xFF,
@@ -190,7 +176,7 @@ const uint8_t BATTALION_HID_CAPABILITIES_IN[] = {
 //It will have bits set (1) where the bit is valid in the controller rumnble report.
 //Not sure if this is required but added it just in case.
 //Ive just guessed what it should be.
-const uint8_t BATTALION_HID_CAPABILITIES_OUT[] = {
+const uint8_t PROGMEM BATTALION_HID_CAPABILITIES_OUT[] = {
     0x00, //Always 0x00
     22,   //bLength - length of packet in bytes
     0xFF, 0xFF, 0xFF, 0xFF,
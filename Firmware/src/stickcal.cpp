@@ -0,0 +1,221 @@
+/*
+ * stickcal.cpp
+ *
+ * See stickcal.h.
+ */
+
+#include "stickcal.h"
+#include "settings.h"
+
+#ifdef ENABLE_STICK_CAL
+#include <string.h>
+#include <avr/eeprom.h>
+
+StickCalRecord_t EEMEM stickCalStore[STICK_CAL_SLOTS];
+uint8_t EEMEM stickCalNextSlot; //Slot to reuse when a new model connects and they are all taken
+
+#define GAIN_ONE (1U << 14)
+
+//Gain that takes reach to full, which is 32767 above centre and 32768 below
+static uint16_t reachGain(uint16_t reach, uint16_t full)
+{
+    if (reach < STICK_CAL_MIN_REACH)
+        return GAIN_ONE;
+    return (((uint32_t)full << 14) + reach - 1) / reach; //Rounded up so the reach itself hits full
+}
+
+static void setAxis(StickCalAxis_t *axis, int16_t centre, uint16_t reachPos, uint16_t reachNeg)
+{
+    //Anything out of range is left over from a bad write, start that axis again
+    if (centre > STICK_CAL_MAX_CENTRE || centre < -STICK_CAL_MAX_CENTRE)
+        centre = 0;
+    if (reachPos > STICK_CAL_MAX_REACH)
+        reachPos = 0;
+    if (reachNeg > STICK_CAL_MAX_REACH)
+        reachNeg = 0;
+    axis->centre = centre;
+    axis->reachPos = reachPos;
+    axis->reachNeg = reachNeg;
+    axis->gainPos = reachGain(reachPos, 32767);
+    axis->gainNeg = reachGain(reachNeg, 32768);
+}
+
+//Find the slot of a controller model, or pick one to claim if it hasn't been seen before
+static uint8_t findSlot(StickCal_t *cal, uint16_t vid, uint16_t pid, bool *found)
+{
+    cal->nextSlot = eeprom_read_byte(&stickCalNextSlot);
+    uint8_t empty = STICK_CAL_SLOTS;
+    for (uint8_t i = 0; i < STICK_CAL_SLOTS; i++)
+    {
+        uint16_t slotVid = eeprom_read_word(&stickCalStore[i].vid);
+        if (slotVid == vid && eeprom_read_word(&stickCalStore[i].pid) == pid)
+        {
+            *found = true;
+            return i;
+        }
+        if (slotVid == 0xFFFF && empty == STICK_CAL_SLOTS)
+            empty = i;
+    }
+
+    uint8_t slot = empty;
+    if (slot == STICK_CAL_SLOTS)
+    {
+        slot = cal->nextSlot % STICK_CAL_SLOTS;
+        cal->nextSlot = (slot + 1) % STICK_CAL_SLOTS; //Written by stickCalFlush() with the new slot
+    }
+    *found = false;
+    return slot;
+}
+
+static void loadSlot(StickCal_t *cal)
+{
+    StickCalRecord_t *record = &cal->record;
+    uint16_t vid = cal->loadVid;
+    uint16_t pid = cal->loadPid;
+    bool found = false;
+    cal->loading = false;
+    cal->slot = findSlot(cal, vid, pid, &found);
+    if (found)
+    {
+        eeprom_read_block(record, &stickCalStore[cal->slot], sizeof(StickCalRecord_t));
+    }
+    else
+    {
+        memset(record, 0x00, sizeof(StickCalRecord_t));
+        record->vid = vid;
+        record->pid = pid;
+        cal->dirty = true;
+    }
+    for (uint8_t i = 0; i < STICK_CAL_AXES; i++)
+    {
+        setAxis(&cal->axis[i], record->centre[i], record->reachPos[i], record->reachNeg[i]);
+        cal->sum[i] = 0;
+    }
+    cal->learning = true;
+    cal->samples = 0;
+}
+
+//Load the calibration of a newly connected controller and start learning its centre. If the
+//last controller's slot is still being written, that finishes first and stickCalFlush() loads
+//this one after it. The sticks aren't corrected until then.
+void stickCalLoad(StickCal_t *cal, uint16_t vid, uint16_t pid, uint32_t now)
+{
+    cal->loadVid = vid;
+    cal->loadPid = pid;
+    cal->learnStart = now;
+    cal->loading = true;
+    stickCalFlush(cal);
+}
+
+static void finishLearning(StickCal_t *cal)
+{
+    cal->learning = false;
+    if (cal->samples < STICK_CAL_MIN_SAMPLES)
+        return;
+    StickCalRecord_t *record = &cal->record;
+    for (uint8_t i = 0; i < STICK_CAL_AXES; i++)
+    {
+        StickCalAxis_t *axis = &cal->axis[i];
+        int16_t centre = cal->sum[i] / cal->samples;
+        setAxis(axis, centre, axis->reachPos, axis->reachNeg);
+        int16_t saved = record->centre[i];
+        if (centre - saved >= STICK_CAL_CENTRE_STEP || saved - centre >= STICK_CAL_CENTRE_STEP)
+        {
+            record->centre[i] = centre;
+            cal->dirty = true;
+        }
+    }
+}
+
+//Grow a reach if value went past it, saving it once it has grown enough
+static void learnReach(StickCal_t *cal, uint16_t *reach, uint16_t *gain, uint16_t *saved, uint16_t value, uint16_t full)
+{
+    if (value <= *reach)
+        return;
+    *reach = value;
+    *gain = reachGain(value, full);
+    if (value >= (uint32_t)*saved + STICK_CAL_REACH_STEP)
+    {
+        *saved = value;
+        cal->dirty = true;
+    }
+}
+
+static int16_t correct(StickCal_t *cal, uint8_t i, int16_t value)
+{
+    StickCalAxis_t *axis = &cal->axis[i];
+    StickCalRecord_t *record = &cal->record;
+    int32_t offset = (int32_t)value - axis->centre;
+    if (offset >= 0)
+    {
+        learnReach(cal, &axis->reachPos, &axis->gainPos, &record->reachPos[i], offset, 32767);
+        offset = (offset * axis->gainPos) >> 14;
+        return offset > 32767 ? 32767 : offset;
+    }
+    learnReach(cal, &axis->reachNeg, &axis->gainNeg, &record->reachNeg[i], -offset, 32768);
+    offset = -((-offset * axis->gainNeg) >> 14);
+    return offset < -32768 ? -32768 : offset;
+}
+
+//Learn from and correct the sticks of a new report.
+void stickCalApply(StickCal_t *cal, InputSnapshot_t *in, uint32_t now)
+{
+    if (cal->loading)
+        return;
+    int16_t *sticks[STICK_CAL_AXES] = {&in->leftStickX, &in->leftStickY, &in->rightStickX, &in->rightStickY};
+
+    if (cal->learning)
+    {
+        bool atRest = true;
+        for (uint8_t i = 0; i < STICK_CAL_AXES; i++)
+        {
+            int32_t offset = (int32_t)*sticks[i] - cal->axis[i].centre;
+            if (offset >= STICK_CAL_REST_LIMIT || offset <= -STICK_CAL_REST_LIMIT)
+                atRest = false;
+        }
+        if (atRest)
+        {
+            for (uint8_t i = 0; i < STICK_CAL_AXES; i++)
+                cal->sum[i] += *sticks[i];
+            cal->samples++;
+        }
+        if (cal->samples >= STICK_CAL_MAX_SAMPLES || now - cal->learnStart >= STICK_CAL_LEARN_MS)
+            finishLearning(cal);
+    }
+
+    for (uint8_t i = 0; i < STICK_CAL_AXES; i++)
+        *sticks[i] = correct(cal, i, *sticks[i]);
+}
+
+//Write one byte of the slot that differs from what was learnt, if EEPROM isn't busy with the
+//last one, then load the next controller if one is waiting. Each byte takes about 3.3ms to
+//write, so this is called from a slow task, and keeps being called after a controller goes
+//away until everything learnt from it is saved.
+void stickCalFlush(StickCal_t *cal)
+{
+    if (!eeprom_is_ready())
+        return;
+    if (cal->dirty)
+    {
+        const uint8_t *learnt = (const uint8_t *)&cal->record;
+        uint8_t *stored = (uint8_t *)&stickCalStore[cal->slot];
+        for (uint8_t i = 0; i < sizeof(StickCalRecord_t); i++)
+        {
+            if (eeprom_read_byte(&stored[i]) != learnt[i])
+            {
+                eeprom_write_byte(&stored[i], learnt[i]);
+                return;
+            }
+        }
+        if (eeprom_read_byte(&stickCalNextSlot) != cal->nextSlot)
+        {
+            eeprom_write_byte(&stickCalNextSlot, cal->nextSlot);
+            return;
+        }
+        cal->dirty = false;
+    }
+    if (cal->loading)
+        loadSlot(cal);
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * stickcal.h
+ *
+ * Stick centre and range calibration. For the first few seconds after a
+ * controller connects, readings taken while the sticks are at rest are
+ * averaged to find each axis' centre. The furthest each axis reaches
+ * either side of centre is tracked all the time. Both are kept in EEPROM
+ * per controller model (VID/PID), so a controller starts out calibrated
+ * the next time it is connected. Until a model's reach has been learnt,
+ * full range is assumed, so pads that stop short (e.g. 8bitdo adaptors at
+ * -32512) are corrected once they have been pushed all the way.
+ *
+ * The correction is worked out when something is learnt. Applying it is a
+ * subtraction and a multiply per axis. Nothing on the report path touches
+ * EEPROM: what is learnt goes into a copy of the slot in RAM, which
+ * stickCalFlush() writes back a byte at a time without waiting, including
+ * after the controller has been unplugged.
+ */
+
+#ifndef STICKCAL_H_
+#define STICKCAL_H_
+#include <inttypes.h>
+#include "inputsnapshot.h"
+
+#define STICK_CAL_AXES 4         //Left X, left Y, right X, right Y
+#define STICK_CAL_SLOTS 8        //Controller models remembered in EEPROM
+#define STICK_CAL_LEARN_MS 2000  //How long after connecting the centre is learnt for
+#define STICK_CAL_MAX_SAMPLES 128 //Learning the centre stops early after this many reports
+#define STICK_CAL_MIN_SAMPLES 16 //Fewer readings at rest than this and the centre isn't changed
+#define STICK_CAL_REST_LIMIT 6144 //Readings further than this from centre aren't at rest
+#define STICK_CAL_CENTRE_STEP 128 //A learnt centre is only saved if it moved by this much
+#define STICK_CAL_MIN_REACH 24576 //Reach below this hasn't been learnt yet, full range is assumed
+#define STICK_CAL_REACH_STEP 1024 //A learnt reach is only saved once it grew by this much
+#define STICK_CAL_MAX_CENTRE 8192 //Stored values past these are treated as corrupt
+#define STICK_CAL_MAX_REACH 40960
+
+//One controller model in EEPROM. Erased EEPROM (vid 0xFFFF) is an empty slot.
+typedef struct
+{
+    uint16_t vid;
+    uint16_t pid;
+    int16_t centre[STICK_CAL_AXES];
+    uint16_t reachPos[STICK_CAL_AXES]; //Furthest reading above centre
+    uint16_t reachNeg[STICK_CAL_AXES]; //Furthest reading below centre
+} StickCalRecord_t;
+
+typedef struct
+{
+    int16_t centre;
+    uint16_t reachPos;
+    uint16_t reachNeg;
+    uint16_t gainPos; //2.14 fixed point
+    uint16_t gainNeg;
+} StickCalAxis_t;
+
+typedef struct
+{
+    StickCalAxis_t axis[STICK_CAL_AXES];
+    StickCalRecord_t record; //What the slot should hold, ahead of EEPROM while dirty
+    bool dirty;
+    uint8_t slot; //EEPROM slot of the connected controller
+    uint8_t nextSlot; //What stickCalNextSlot should hold
+    bool loading; //Waiting for the last slot to be written before loading loadVid/loadPid
+    uint16_t loadVid;
+    uint16_t loadPid;
+    bool learning; //Still learning the centre
+    uint8_t samples;
+    uint32_t learnStart;
+    int32_t sum[STICK_CAL_AXES];
+} StickCal_t;
+
+void stickCalLoad(StickCal_t *cal, uint16_t vid, uint16_t pid, uint32_t now);
+void stickCalApply(StickCal_t *cal, InputSnapshot_t *in, uint32_t now);
+void stickCalFlush(StickCal_t *cal);
+
+#endif /* STICKCAL_H_ */
@@ -0,0 +1,137 @@
+/*
+ * stickcurve.cpp
+ *
+ * See stickcurve.h.
+ */
+
+#include "stickcurve.h"
+#include "settings.h"
+
+#ifdef ENABLE_STICK_CURVE
+
+//y = x^2
+const uint16_t CURVE_QUADRATIC[STICK_CURVE_POINTS] PROGMEM = {
+    0, 2, 8, 18, 32, 50, 72, 98, 128, 162, 200, 242,
+    288, 338, 392, 450, 512, 578, 648, 722, 800, 882, 968, 1058,
+    1152, 1250, 1352, 1458, 1568, 1682, 1800, 1922, 2048, 2178, 2312, 2450,
+    2592, 2738, 2888, 3042, 3200, 3362, 3528, 3698, 3872, 4050, 4232, 4418,
+    4608, 4802, 5000, 5202, 5408, 5618, 5832, 6050, 6272, 6498, 6728, 6962,
+    7200, 7442, 7688, 7938, 8192, 8450, 8712, 8978, 9248, 9522, 9800, 10082,
+    10368, 10658, 10952, 11250, 11552, 11858, 12168, 12482, 12800, 13122, 13448, 13778,
+    14112, 14450, 14792, 15138, 15488, 15842, 16200, 16561, 16927, 17297, 17671, 18049,
+    18431, 18817, 19207, 19601, 19999, 20401, 20807, 21217, 21631, 22049, 22471, 22897,
+    23327, 23761, 24199, 24641, 25087, 25537, 25991, 26449, 26911, 27377, 27847, 28321,
+    28799, 29281, 29767, 30257, 30751, 31249, 31751, 32257, 32767,
+};
+
+//y = 3x^2 - 2x^3, gentle around the centre and the edge
+const uint16_t CURVE_SCURVE[STICK_CURVE_POINTS] PROGMEM = {
+    0, 6, 24, 53, 94, 146, 209, 283, 368, 463, 569, 684,
+    810, 945, 1090, 1244, 1408, 1580, 1762, 1952, 2150, 2357, 2571, 2794,
+    3024, 3262, 3507, 3759, 4018, 4284, 4556, 4835, 5120, 5411, 5708, 6010,
+    6318, 6631, 6949, 7272, 7600, 7932, 8268, 8609, 8954, 9302, 9654, 10009,
+    10368, 10729, 11093, 11460, 11830, 12201, 12575, 12950, 13328, 13706, 14086, 14467,
+    14850, 15232, 15616, 16000, 16384, 16767, 17151, 17535, 17917, 18300, 18681, 19061,
+    19439, 19817, 20192, 20566, 20937, 21307, 21674, 22038, 22399, 22758, 23113, 23465,
+    23813, 24158, 24499, 24835, 25167, 25495, 25818, 26136, 26449, 26757, 27059, 27356,
+    27647, 27932, 28211, 28483, 28749, 29008, 29260, 29505, 29743, 29973, 30196, 30410,
+    30617, 30815, 31005, 31187, 31359, 31523, 31677, 31822, 31957, 32083, 32198, 32304,
+    32399, 32484, 32558, 32621, 32673, 32714, 32743, 32761, 32767,
+};
+
+const char STICK_NAME_BYPASS[] PROGMEM = "Raw";
+const char STICK_NAME_LINEAR[] PROGMEM = "Linear";
+const char STICK_NAME_QUADRATIC[] PROGMEM = "Quad";
+const char STICK_NAME_SCURVE[] PROGMEM = "S-curve";
+const char STICK_NAME_ANTI_DEADZONE[] PROGMEM = "Anti-DZ";
+
+const StickProfile_t STICK_PROFILES[] PROGMEM = {
+    {STICK_NAME_BYPASS, NULL, 0, 100, 0},
+    {STICK_NAME_LINEAR, NULL, 8, 95, 0},
+    {STICK_NAME_QUADRATIC, CURVE_QUADRATIC, 8, 95, 0},
+    {STICK_NAME_SCURVE, CURVE_SCURVE, 8, 95, 0},
+    //Linear, but the first movement past the deadzone already gives 20%, to get past the
+    //deadzone many games apply themselves, so small movements aren't lost twice
+    {STICK_NAME_ANTI_DEADZONE, NULL, 8, 95, 20}};
+const uint8_t STICK_PROFILE_COUNT = sizeof(STICK_PROFILES) / sizeof(StickProfile_t);
+
+static uint16_t isqrt32(uint32_t n)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > n)
+        bit >>= 2;
+    while (bit)
+    {
+        if (n >= root + bit)
+        {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+void stickCurveLoad(StickCurve_t *curve, uint8_t profile)
+{
+    StickProfile_t p;
+    memcpy_P(&p, &STICK_PROFILES[profile], sizeof(StickProfile_t));
+
+    curve->bypass = (profile == STICK_PROFILE_BYPASS);
+    curve->curve = p.curve;
+    curve->deadzone = (uint16_t)p.deadzone * STICK_FULL_SCALE / 100;
+    curve->saturation = (uint16_t)p.saturation * STICK_FULL_SCALE / 100;
+    if (curve->saturation <= curve->deadzone)
+        curve->saturation = curve->deadzone + 1;
+    curve->rangeFactor = (32768UL << 8) / (curve->saturation - curve->deadzone);
+    curve->antiDeadzone = (uint32_t)p.antiDeadzone * 32767 / 100;
+}
+
+void stickCurveApply(const StickCurve_t *curve, int16_t *x, int16_t *y)
+{
+    if (curve->bypass)
+        return;
+
+    int16_t xs = *x >> 4;
+    int16_t ys = *y >> 4;
+    uint16_t magnitude = isqrt32((int32_t)xs * xs + (int32_t)ys * ys);
+    if (magnitude <= curve->deadzone)
+    {
+        *x = 0;
+        *y = 0;
+        return;
+    }
+
+    //Position between the deadzone and saturation, 0 to 32768 (128 table steps in 8.8)
+    uint16_t t = 32768;
+    if (magnitude < curve->saturation)
+        t = ((uint32_t)(magnitude - curve->deadzone) * curve->rangeFactor) >> 8;
+
+    uint16_t out;
+    uint8_t i = t >> 8;
+    if (!curve->curve)
+        out = (t > 32767) ? 32767 : t;
+    else if (i >= STICK_CURVE_POINTS - 1)
+        out = pgm_read_word(&curve->curve[STICK_CURVE_POINTS - 1]);
+    else
+    {
+        uint16_t a = pgm_read_word(&curve->curve[i]);
+        uint16_t b = pgm_read_word(&curve->curve[i + 1]);
+        out = a + (((uint32_t)(b - a) * (t & 0xFF)) >> 8);
+    }
+
+    if (curve->antiDeadzone)
+        out = curve->antiDeadzone + (((uint32_t)out * (32767 - curve->antiDeadzone)) >> 15);
+
+    //Keep the direction, replace the magnitude
+    uint32_t k = ((uint32_t)out << 11) / magnitude;
+    *x = ((int32_t)xs * (int32_t)k) >> 11;
+    *y = ((int32_t)ys * (int32_t)k) >> 11;
+}
+
+#endif
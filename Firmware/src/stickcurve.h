@@ -0,0 +1,57 @@
+/*
+ * stickcurve.h
+ *
+ * Radial deadzone, outer saturation, anti-deadzone and response curves
+ * for the analog sticks. Profiles and curve tables live in flash, and the
+ * divisions are done once when a profile is loaded. Per report each stick
+ * costs one square root, two table reads and one division.
+ */
+
+#ifndef STICKCURVE_H_
+#define STICKCURVE_H_
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+#define STICK_CURVE_POINTS 129 //Curve tables cover 0 to 1 in 128 steps, output 0 to 32767
+#define STICK_FULL_SCALE 2048  //Stick magnitude is worked out on the axis values >> 4
+
+typedef struct
+{
+    const char *name;      //PROGMEM string, for the OLED
+    const uint16_t *curve; //PROGMEM table of STICK_CURVE_POINTS, NULL for linear
+    uint8_t deadzone;      //Percent of full deflection ignored around the centre
+    uint8_t saturation;    //Percent of full deflection that already gives full output
+    uint8_t antiDeadzone;  //Percent of full output the first movement past the deadzone gives
+} StickProfile_t;
+
+//Profile loaded into RAM, with the divisions already done
+typedef struct
+{
+    const uint16_t *curve;
+    uint16_t deadzone;   //Magnitude, STICK_FULL_SCALE is full deflection
+    uint16_t saturation;
+    uint32_t rangeFactor; //Maps deadzone..saturation onto 0..32768, 8.8 fixed point
+    uint16_t antiDeadzone; //0 to 32767
+    bool bypass;
+} StickCurve_t;
+
+#define STICK_PROFILE_BYPASS 0 //Sticks are passed through untouched
+extern const StickProfile_t STICK_PROFILES[] PROGMEM;
+extern const uint8_t STICK_PROFILE_COUNT;
+
+void stickCurveLoad(StickCurve_t *curve, uint8_t profile);
+void stickCurveApply(const StickCurve_t *curve, int16_t *x, int16_t *y);
+
+//Exact expansion of an 8-bit stick value (0 to 255) onto the full 16-bit range (-32768 to 32767)
+inline int16_t expandStick8(uint8_t v)
+{
+    return (int16_t)((uint16_t)v * 257 - 32768);
+}
+
+//As expandStick8(), inverted (0 gives 32767, 255 gives -32768)
+inline int16_t expandStick8Inverted(uint8_t v)
+{
+    return ~expandStick8(v);
+}
+
+#endif /* STICKCURVE_H_ */
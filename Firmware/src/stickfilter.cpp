@@ -0,0 +1,54 @@
+/*
+ * stickfilter.cpp
+ *
+ * See stickfilter.h.
+ */
+
+#include "stickfilter.h"
+#include "settings.h"
+
+#ifdef ENABLE_STICK_FILTER
+
+void stickFilterReset(StickFilterAxis_t *axis, int16_t value, int16_t hold)
+{
+    axis->value = (int32_t)value << 8;
+    axis->speed = 0;
+    axis->out = value;
+    axis->raw = value;
+    axis->hold = hold;
+}
+
+int16_t stickFilterAxis(StickFilterAxis_t *axis, int16_t value)
+{
+    int32_t delta = ((int32_t)value << 8) - axis->value;
+    int32_t change = (delta < 0 ? -delta : delta) >> 8;
+    if (change >= STICK_FILTER_BYPASS)
+    {
+        stickFilterReset(axis, value, axis->hold);
+        axis->speed = STICK_FILTER_BYPASS;
+        return value;
+    }
+
+    //Cutoff rises with the speed of the stick
+    axis->speed += ((int16_t)change - axis->speed) >> STICK_FILTER_SPEED_SHIFT;
+    uint16_t alpha = STICK_FILTER_MIN_ALPHA + (axis->speed >> STICK_FILTER_BETA_SHIFT);
+    if (alpha > 256)
+        alpha = 256;
+
+    //delta is below STICK_FILTER_BYPASS << 8 here, so this can't overflow
+    axis->value += (delta * alpha) >> 8;
+
+    int16_t filtered = (axis->value + 128) >> 8;
+    int16_t moved = filtered - axis->out;
+    int16_t settle = filtered - value;
+    bool steady = value == axis->raw;
+    axis->raw = value;
+    if (moved >= axis->hold || moved <= -axis->hold)
+        axis->out = filtered;
+    //A stick at rest ends up exactly where it stopped, not up to a hold away
+    else if (steady && settle < axis->hold && settle > -axis->hold)
+        axis->out = value;
+    return axis->out;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * stickfilter.h
+ *
+ * Adaptive low-pass filter for the analog sticks, an integer take on the
+ * one euro filter. While a stick barely moves it is smoothed heavily,
+ * which hides the jitter of worn sticks around centre. The faster it moves
+ * the less it is smoothed, and a jump of STICK_FILTER_BYPASS or more in
+ * one report passes straight through, so flicks get no added latency.
+ *
+ * The output also only moves once the filtered value has moved by the
+ * hold, so a jittering stick stops producing changed reports. The hold is
+ * under one step of the source, so slow aiming isn't made coarser, and once
+ * the stick settles the output snaps to where it came to rest.
+ *
+ * It runs once per controller report, which arrive at a steady rate, so
+ * the time step is taken as constant.
+ */
+
+#ifndef STICKFILTER_H_
+#define STICKFILTER_H_
+#include <inttypes.h>
+
+#define STICK_FILTER_BYPASS 4096   //Changes this big in one report are passed through unfiltered
+#define STICK_FILTER_MIN_ALPHA 32  //Smoothing of a still stick, out of 256. Lower is smoother
+#define STICK_FILTER_BETA_SHIFT 4  //How quickly smoothing is reduced as the stick speeds up
+#define STICK_FILTER_SPEED_SHIFT 2 //Smoothing of the speed estimate itself
+#define STICK_FILTER_HOLD_8BIT 192 //Output hysteresis for 8-bit sticks, under one step (257)
+#define STICK_FILTER_HOLD_16BIT 16 //Output hysteresis for 16-bit sticks
+
+typedef struct
+{
+    int32_t value; //Filtered position, 8.8 fixed point
+    int16_t speed; //Smoothed change per report
+    int16_t out;   //Last output
+    int16_t raw;   //Last input
+    int16_t hold;  //STICK_FILTER_HOLD_8BIT or STICK_FILTER_HOLD_16BIT, by the resolution of the source
+} StickFilterAxis_t;
+
+void stickFilterReset(StickFilterAxis_t *axis, int16_t value, int16_t hold);
+int16_t stickFilterAxis(StickFilterAxis_t *axis, int16_t value);
+
+#endif /* STICKFILTER_H_ */
@@ -0,0 +1,101 @@
+/*
+ * telemetry.cpp
+ *
+ * See telemetry.h.
+ */
+
+#include "telemetry.h"
+#include "settings.h"
+
+#ifdef ENABLE_TELEMETRY
+#include "scheduler.h"
+#include "xiddriver.h"
+#include <Arduino.h>
+#include <Usb.h>
+
+static_assert(TELEMETRY_RUN_BUCKETS == SCHEDULER_HISTOGRAM_BUCKETS, "Telemetry run time buckets must match the scheduler");
+static_assert(TELEMETRY_MAX_TASKS >= SCHEDULER_MAX_TASKS, "Telemetry must have room for every scheduler task");
+#ifdef ENABLE_LATENCY_STATS
+static_assert(TELEMETRY_AGE_BUCKETS == DUKE_LATENCY_BUCKETS, "Telemetry report age buckets must match xiddriver.h");
+#endif
+
+extern USB UsbHost;
+
+static TelemetryBlock_t block = {TELEMETRY_VERSION, sizeof(TelemetryBlock_t)};
+static uint32_t deviceResetTime;
+static uint16_t deviceEnumTime;
+static uint8_t hostState = USB_DETACHED_SUBSTATE_INITIALIZE;
+static uint32_t hostAttachTime;
+static uint16_t hostEnumTime;
+
+static uint16_t elapsedSince(uint32_t time)
+{
+    uint32_t elapsed = millis() - time;
+    return elapsed > 0xFFFF ? 0xFFFF : elapsed;
+}
+
+//Refresh the block from the counters, from the main loop. Every field is written in place rather
+//than clearing the block first, so a read in between never sees zeroes.
+void telemetryUpdate()
+{
+    block.uptime = millis();
+
+    memcpy(block.runTimes, schedulerHistogram(), sizeof(block.runTimes));
+    block.taskCount = schedulerTaskCount();
+    for (uint8_t i = 0; i < block.taskCount; i++)
+    {
+        const SchedulerStats_t *s = schedulerStats(i);
+        block.tasks[i].overruns = s->overruns;
+        block.tasks[i].misses = s->misses;
+        block.tasks[i].longest = s->longest;
+    }
+
+    const USB_XFER_STATS &xfer = UsbHost.getXferStats();
+    block.hostNaks = xfer.naks;
+    block.hostTimeouts = xfer.timeouts;
+    block.hostErrors = xfer.errors;
+
+#ifdef ENABLE_LATENCY_STATS
+    DukeINStats_t in;
+    DukeReadINStats(&in);
+    memcpy(block.reportAge, in.age, sizeof(block.reportAge));
+    block.reportsReplaced = in.replaced;
+#endif
+
+    block.deviceEnumTime = deviceEnumTime;
+    block.hostEnumTime = hostEnumTime;
+}
+
+//The block as of the last telemetryUpdate(), for the control request
+const TelemetryBlock_t *telemetryBlock(void)
+{
+    return &block;
+}
+
+//USB device side, called from the LUFA events
+void telemetryDeviceReset(void)
+{
+    deviceResetTime = millis();
+}
+
+void telemetryDeviceConfigured(void)
+{
+    deviceEnumTime = elapsedSince(deviceResetTime);
+}
+
+//USB host side. Call with UsbHost.getUsbTaskState() after every UsbHost.Task()
+void telemetryHostState(uint8_t usbTaskState)
+{
+    bool detached = (usbTaskState & USB_STATE_MASK) == USB_STATE_DETACHED;
+    if (!detached && (hostState & USB_STATE_MASK) == USB_STATE_DETACHED)
+        hostAttachTime = millis();
+    hostState = usbTaskState;
+}
+
+//A controller driver has reported the controller connected
+void telemetryHostConnected()
+{
+    hostEnumTime = elapsedSince(hostAttachTime);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * telemetry.h
+ *
+ * Performance counters for diagnostics, built with ENABLE_TELEMETRY. With
+ * the adapter plugged into a PC instead of a console, a vendor control
+ * request (see EVENT_USB_Device_ControlRequest() in xiddevice.c) returns
+ * them as one TelemetryBlock_t, which tools/telemetry.py decodes. An OG
+ * Xbox never makes the request, so nothing changes on a console.
+ *
+ * The main loop refreshes the block every few milliseconds with
+ * telemetryUpdate(), so the USB interrupt only copies it out. A field being
+ * written at that moment can be torn. The 32-bit counts wrap and the 16-bit
+ * ones stop at 0xFFFF, compare two reads to get rates.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+#include <inttypes.h>
+
+#define TELEMETRY_REQUEST 0x54 //bRequest, with bmRequestType 0xC0 (vendor, device to host, device)
+#define TELEMETRY_VERSION 1    //Changes whenever TelemetryBlock_t does
+
+//Sizes of the arrays in the block. Fixed so the layout doesn't depend on build options
+#define TELEMETRY_RUN_BUCKETS 8 //SCHEDULER_HISTOGRAM_BUCKETS
+#define TELEMETRY_MAX_TASKS 6   //SCHEDULER_MAX_TASKS
+#define TELEMETRY_AGE_BUCKETS 8 //DUKE_LATENCY_BUCKETS
+
+typedef struct
+{
+    uint16_t overruns;
+    uint16_t misses;
+    uint16_t longest; //Microseconds
+} TelemetryTask_t;
+
+//Little endian and packed, the AVR has no alignment padding
+typedef struct
+{
+    uint8_t version;                           //TELEMETRY_VERSION
+    uint8_t size;                              //sizeof(TelemetryBlock_t)
+    uint32_t uptime;                           //Milliseconds
+    uint32_t runTimes[TELEMETRY_RUN_BUCKETS];  //Main loop task run times, see scheduler.h
+    uint8_t taskCount;
+    TelemetryTask_t tasks[TELEMETRY_MAX_TASKS]; //In the order of TASKS[] in main.cpp
+    uint32_t hostNaks;                         //USB host packet results, see USB_XFER_STATS
+    uint32_t hostTimeouts;
+    uint32_t hostErrors;
+    uint16_t reportAge[TELEMETRY_AGE_BUCKETS]; //Duke reports by age in frames when read, see DukeINStats_t. Zero without ENABLE_LATENCY_STATS
+    uint16_t reportsReplaced;
+    uint16_t deviceEnumTime; //Milliseconds from the last bus reset by the console or PC to SET_CONFIGURATION
+    uint16_t hostEnumTime;   //Milliseconds from the last controller attach until its driver was ready
+} TelemetryBlock_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    const TelemetryBlock_t *telemetryBlock(void);
+    void telemetryDeviceReset(void);
+    void telemetryDeviceConfigured(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+void telemetryUpdate();
+void telemetryHostState(uint8_t usbTaskState);
+void telemetryHostConnected();
+#endif
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,49 @@
+/*
+ * turbo.cpp
+ *
+ * See turbo.h.
+ */
+
+#include "turbo.h"
+#include "settings.h"
+
+#ifdef ENABLE_TURBO
+
+void turboReset(Turbo_t *turbo)
+{
+    for (uint8_t i = 0; i < TURBO_RATES; i++)
+        turbo->rate[i] = 0;
+    turbo->autoFire = 0;
+}
+
+//TURBO_OFF, 1 to TURBO_RATES for turbo at that rate, or TURBO_AUTO
+uint8_t turboMode(const Turbo_t *turbo, uint16_t button)
+{
+    if (turbo->autoFire & button)
+        return TURBO_AUTO;
+    for (uint8_t i = 0; i < TURBO_RATES; i++)
+    {
+        if (turbo->rate[i] & button)
+            return i + 1;
+    }
+    return TURBO_OFF;
+}
+
+//Off -> Fast -> Medium -> Slow -> Auto fire (at the fast rate) -> Off
+void turboCycle(Turbo_t *turbo, uint16_t button)
+{
+    uint8_t mode = turboMode(turbo, button);
+    for (uint8_t i = 0; i < TURBO_RATES; i++)
+        turbo->rate[i] &= ~button;
+    turbo->autoFire &= ~button;
+
+    if (mode < TURBO_RATES)
+        turbo->rate[mode] |= button;
+    else if (mode == TURBO_RATES)
+    {
+        turbo->rate[0] |= button;
+        turbo->autoFire |= button;
+    }
+}
+
+#endif
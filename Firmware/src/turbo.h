@@ -0,0 +1,51 @@
+/*
+ * turbo.h
+ *
+ * Turbo and auto fire. A turbo button repeatedly presses and releases
+ * while it is held, an auto fire button does so without being held. The
+ * cadence comes from the USB frame number, so it lines up exactly with the
+ * console polling the Duke endpoint and needs no timers. Applying it is a
+ * few masks per report.
+ */
+
+#ifndef TURBO_H_
+#define TURBO_H_
+#include <inttypes.h>
+
+#define TURBO_RATES 3 //Fast, medium and slow
+#define TURBO_SHIFT 5 //The fast rate is 32 frames pressed, 32 released. Each slower rate doubles that
+
+typedef struct
+{
+    uint16_t rate[TURBO_RATES]; //IN_* bits pulsing at each rate
+    uint16_t autoFire;          //IN_* bits that pulse without being held, always also in rate[0]
+} Turbo_t;
+
+#define TURBO_OFF 0
+#define TURBO_AUTO (TURBO_RATES + 1) //turboMode() values 1 to TURBO_RATES are the turbo rates
+
+void turboReset(Turbo_t *turbo);
+uint8_t turboMode(const Turbo_t *turbo, uint16_t button);
+void turboCycle(Turbo_t *turbo, uint16_t button);
+
+//True if any button has turbo or auto fire on
+inline bool turboActive(const Turbo_t *turbo)
+{
+    return turbo->rate[0] | turbo->rate[1] | turbo->rate[2];
+}
+
+//The held buttons as they should be reported during USB frame number frame
+inline uint16_t turboApply(const Turbo_t *turbo, uint16_t held, uint16_t frame)
+{
+    uint16_t released = 0;
+    frame >>= TURBO_SHIFT;
+    if (frame & 1)
+        released |= turbo->rate[0];
+    if (frame & 2)
+        released |= turbo->rate[1];
+    if (frame & 4)
+        released |= turbo->rate[2];
+    return (held | turbo->autoFire) & ~released;
+}
+
+#endif /* TURBO_H_ */
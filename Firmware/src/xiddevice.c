@@ -31,19 +31,88 @@ this software.
 #include "settings.h"
 #include "xiddevice.h"
 #include "dukecontroller.h"
+#include "telemetry.h"
+#include <util/atomic.h>
+
+extern volatile bool enumerationComplete;
+extern volatile uint8_t ConnectedXID;
+
+//State shared between the main loop and the USB side, the input side is in xiddriver.c.
+//Rumble: a seqlock. The writer makes RumbleSeq odd while it updates the levels, readers retry
+//if it was odd or changed while they read. The writer must not be interruptible by a reader.
+static volatile uint8_t RumbleSeq = 0;
+static volatile uint8_t RumbleLeft = 0;
+static volatile uint8_t RumbleRight = 0;
+
+#define DUKE_OUT_ENDPOINT 0x02
+#define DUKE_OUT_REPORT_SIZE 6
+
+//Rumble arrives both through SET_REPORT and on the OUT endpoint. The SOF interrupt that reads the
+//OUT endpoint can run in the middle of a control request, so each update is made atomic to keep
+//the sequence count even.
+static void DukeWriteRumble(uint8_t left, uint8_t right)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        RumbleSeq++;
+        RumbleLeft = left;
+        RumbleRight = right;
+        RumbleSeq++;
+    }
+}
+
+//Everything that makes up an emulated XID device, all in PROGMEM
+typedef struct
+{
+    uint8_t type;                  //DUKE_CONTROLLER or STEELBATTALION, selects the endpoints and reports
+    const uint8_t *device;         //USB device descriptor
+    const uint8_t *configuration;  //USB configuration descriptor, with the interface and endpoints
+    const uint8_t *xid;            //XID descriptor
+    const uint8_t *capabilitiesIn; //GET_CAPABILITIES responses. Each gives its length in its second byte
+    const uint8_t *capabilitiesOut;
+} XidPersonality_t;
+
+//Indexed by the XID_* personality numbers in xiddevice.h
+static const XidPersonality_t XID_PERSONALITIES[XID_PERSONALITY_COUNT] PROGMEM = {
+    {DUKE_CONTROLLER, DUKE_USB_DESCRIPTOR_DEVICE, DUKE_USB_DESCRIPTOR_CONFIGURATION, DUKE_HID_DESCRIPTOR_XID,
+     DUKE_HID_CAPABILITIES_IN, DUKE_HID_CAPABILITIES_OUT},
+    {DUKE_CONTROLLER, CONTROLLER_S_USB_DESCRIPTOR_DEVICE, DUKE_USB_DESCRIPTOR_CONFIGURATION, CONTROLLER_S_HID_DESCRIPTOR_XID,
+     DUKE_HID_CAPABILITIES_IN, DUKE_HID_CAPABILITIES_OUT},
+#ifdef SUPPORTBATTALION
+    {STEELBATTALION, BATTALION_USB_DESCRIPTOR_DEVICE, BATTALION_USB_DESCRIPTOR_CONFIGURATION, BATTALION_HID_DESCRIPTOR_XID,
+     BATTALION_HID_CAPABILITIES_IN, BATTALION_HID_CAPABILITIES_OUT},
+#endif
+};
 
-// #ifdef SUPPORTBATTALION
-// #include "steelbattalion.h"
-// #endif
+//The personality presented to the console, set with XidSetPersonality()
+volatile uint8_t XidPersonality = XID_CONTROLLER_S;
 
-extern bool enumerationComplete;
-extern uint8_t ConnectedXID;
+static const uint8_t *XidDescriptor(const uint8_t *const *field)
+{
+    return (const uint8_t *)pgm_read_ptr(field);
+}
 
-USB_XboxGamepad_Data_t PrevDukeHIDReportBuffer;
+/** Switch the emulated XID device. If attached, the adapter detaches so the console sees the old
+ *  device unplugged. The caller attaches again after XID_DETACH_MS and the console enumerates the
+ *  new one. */
+void XidSetPersonality(uint8_t personality)
+{
+    if (personality >= XID_PERSONALITY_COUNT)
+        personality = XID_CONTROLLER_S;
 
-// #ifdef SUPPORTBATTALION
-// USB_XboxSteelBattalion_Data_t PrevBattalionHIDReportBuffer;
-// #endif
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (USB_DeviceState != DEVICE_STATE_Unattached)
+        {
+            USB_Detach();
+            //Stops the report paths touching the endpoints until the console resets and configures the new device
+            USB_DeviceState = DEVICE_STATE_Powered;
+        }
+        enumerationComplete = false;
+        XidPersonality = personality;
+        ConnectedXID = pgm_read_byte(&XID_PERSONALITIES[personality].type);
+    }
+}
 
 /** LUFA HID Class driver interface configuration and state information. This structure is
 passed to all HID Class driver functions, so that multiple instances of the same class
@@ -53,15 +122,85 @@ USB_ClassInfo_HID_Device_t DukeController_HID_Interface = {
     .Config = {
         .InterfaceNumber = 0x00,
         .ReportINEndpoint = {
-            .Address = 0x81,
-            .Size = 20,
-            .Banks = 1,
+            .Address = DUKE_IN_ENDPOINT,
+            .Size = DUKE_REPORT_SIZE,
+            .Banks = 2,
         },
-        .PrevReportINBuffer = &PrevDukeHIDReportBuffer,
-        .PrevReportINBufferSize = sizeof(PrevDukeHIDReportBuffer),
+        //No copy of the last report is kept. IN reports are loaded by xiddriver.c, the HID task
+        //isn't used. The report callback still answers GET_REPORT
+        .PrevReportINBuffer = NULL,
+        .PrevReportINBufferSize = DUKE_REPORT_SIZE,
     },
 };
 
+#ifdef SUPPORTBATTALION
+USB_ClassInfo_HID_Device_t SteelBattalion_HID_Interface = {
+    .Config = {
+        .InterfaceNumber = 0x00,
+        .ReportINEndpoint = {
+            .Address = BATTALION_IN_ENDPOINT,
+            .Size = BATTALION_ENDPOINT_SIZE,
+            .Banks = 2,
+        },
+        //Loaded by xiddriver.c like the Duke
+        .PrevReportINBuffer = NULL,
+        .PrevReportINBufferSize = BATTALION_REPORT_SIZE,
+    },
+};
+#endif
+
+/** Read the rumble levels last sent by the console. Returns true if they are newer than *seen,
+ *  the sequence number of the previous read, which is then updated. */
+bool DukeReadRumble(uint8_t *left, uint8_t *right, uint8_t *seen)
+{
+    uint8_t seq;
+    do
+    {
+        seq = RumbleSeq;
+        *left = RumbleLeft;
+        *right = RumbleRight;
+    } while ((seq & 1) || seq != RumbleSeq);
+
+    if (seq == *seen)
+        return false;
+    *seen = seq;
+    return true;
+}
+
+/** Some games (THPS 2X for one) send rumble on the OUT endpoint instead of the control pipe.
+ *  Polled from the SOF interrupt, the report has the same layout as SET_REPORT. Leaves another
+ *  endpoint selected, the caller restores it. */
+static void ReadOutEndpoint(void)
+{
+#ifdef SUPPORTBATTALION
+    //Steel Battalion OUT reports set the cockpit lights, which the adapter has nothing to show on
+    if (ConnectedXID == STEELBATTALION)
+    {
+        Endpoint_SelectEndpoint(BATTALION_OUT_ENDPOINT);
+        if (Endpoint_IsOUTReceived())
+            Endpoint_ClearOUT();
+        return;
+    }
+#endif
+
+    Endpoint_SelectEndpoint(DUKE_OUT_ENDPOINT);
+    if (!Endpoint_IsOUTReceived())
+        return;
+
+    uint8_t report[DUKE_OUT_REPORT_SIZE];
+    uint8_t length = Endpoint_BytesInEndpoint();
+    for (uint8_t i = 0; i < length; i++)
+    {
+        uint8_t b = Endpoint_Read_8();
+        if (i < DUKE_OUT_REPORT_SIZE)
+            report[i] = b;
+    }
+    Endpoint_ClearOUT();
+
+    if (ConnectedXID == DUKE_CONTROLLER && length == DUKE_OUT_REPORT_SIZE && report[1] == DUKE_OUT_REPORT_SIZE)
+        DukeWriteRumble(report[3], report[5]);
+}
+
 /** Configures the board hardware and chip peripherals */
 void SetupHardware(void)
 {
@@ -76,6 +215,14 @@ void EVENT_USB_Device_Connect(void)
 {
 }
 
+/** Event handler for the library USB Reset event. */
+void EVENT_USB_Device_Reset(void)
+{
+#ifdef ENABLE_TELEMETRY
+    telemetryDeviceReset();
+#endif
+}
+
 /** Event handler for the library USB Disconnection event. */
 void EVENT_USB_Device_Disconnect(void)
 {
@@ -91,12 +238,21 @@ void EVENT_USB_Device_ConfigurationChanged(void)
     {
     case DUKE_CONTROLLER:
         ConfigSuccess &= HID_Device_ConfigureEndpoints(&DukeController_HID_Interface);
-        ConfigSuccess &= Endpoint_ConfigureEndpoint(0x02, EP_TYPE_INTERRUPT, 6, 1); //Host Out endpoint opened manually for Duke.
+        DukeINReset();
+        ConfigSuccess &= Endpoint_ConfigureEndpoint(DUKE_OUT_ENDPOINT, EP_TYPE_INTERRUPT, DUKE_OUT_REPORT_SIZE, 1); //Host Out endpoint opened manually for Duke.
         break;
-
+#ifdef SUPPORTBATTALION
+    case STEELBATTALION:
+        ConfigSuccess &= HID_Device_ConfigureEndpoints(&SteelBattalion_HID_Interface);
+        ConfigSuccess &= Endpoint_ConfigureEndpoint(BATTALION_OUT_ENDPOINT, EP_TYPE_INTERRUPT, BATTALION_ENDPOINT_SIZE, 1);
+        break;
+#endif
     }
     USB_Device_EnableSOFEvents();
     enumerationComplete = ConfigSuccess;
+#ifdef ENABLE_TELEMETRY
+    telemetryDeviceConfigured();
+#endif
 }
 
 /** Event handler for the library USB Control Request reception event. */
@@ -108,49 +264,35 @@ void EVENT_USB_Device_ControlRequest(void)
     //See http://xboxdevwiki.net/Xbox_Input_Devices under GET_DESCRIPTOR and GET_CAPABILITIES
     //The actual responses were obtained from a USB analyser when communicating with an OG Xbox console.
 
+#ifdef ENABLE_TELEMETRY
+    //Performance counters, for a PC only. See telemetry.h
+    if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE) &&
+        USB_ControlRequest.bRequest == TELEMETRY_REQUEST)
+    {
+        Endpoint_ClearSETUP();
+        Endpoint_Write_Control_Stream_LE(telemetryBlock(), MIN(USB_ControlRequest.wLength, sizeof(TelemetryBlock_t)));
+        Endpoint_ClearOUT();
+        return;
+    }
+#endif
+
     if (USB_ControlRequest.bmRequestType == 0xC1)
     {
+        const XidPersonality_t *personality = &XID_PERSONALITIES[XidPersonality];
+        const uint8_t *response = NULL;
         if (USB_ControlRequest.bRequest == 0x06 && USB_ControlRequest.wValue == 0x4200)
-        {
-            Endpoint_ClearSETUP();
-            switch (ConnectedXID)
-            {
-            case DUKE_CONTROLLER:
-                Endpoint_Write_Control_Stream_LE(&DUKE_HID_DESCRIPTOR_XID, 16);
-                break;
-#ifdef SUPPORTBATTALION
-            case STEELBATTALION:
-                Endpoint_Write_Control_Stream_LE(&BATTALION_HID_DESCRIPTOR_XID, 16);
-                break;
-#endif
-            }
-            Endpoint_ClearOUT();
-            return;
-        }
+            response = XidDescriptor(&personality->xid);
         else if (USB_ControlRequest.bRequest == 0x01 && USB_ControlRequest.wValue == 0x0100)
-        {
-            Endpoint_ClearSETUP();
-            switch (ConnectedXID)
-            {
-            case DUKE_CONTROLLER:
-                Endpoint_Write_Control_Stream_LE(&DUKE_HID_CAPABILITIES_IN, 20);
-                break;
-
-            }
-
-            Endpoint_ClearOUT();
-            return;
-        }
+            response = XidDescriptor(&personality->capabilitiesIn);
         else if (USB_ControlRequest.bRequest == 0x01 && USB_ControlRequest.wValue == 0x0200)
+            response = XidDescriptor(&personality->capabilitiesOut);
+
+        if (response != NULL)
         {
+            //The XID descriptor has its length in the first byte, the capabilities in the second
+            uint8_t length = pgm_read_byte(&response[USB_ControlRequest.bRequest == 0x06 ? 0 : 1]);
             Endpoint_ClearSETUP();
-            switch (ConnectedXID)
-            {
-            case DUKE_CONTROLLER:
-                Endpoint_Write_Control_Stream_LE(&DUKE_HID_CAPABILITIES_OUT, 6);
-                break;
-
-            }
+            Endpoint_Write_Control_PStream_LE(response, length);
             Endpoint_ClearOUT();
             return;
         }
@@ -162,19 +304,35 @@ void EVENT_USB_Device_ControlRequest(void)
     case DUKE_CONTROLLER:
         HID_Device_ProcessControlRequest(&DukeController_HID_Interface);
         break;
-
+#ifdef SUPPORTBATTALION
+    case STEELBATTALION:
+        HID_Device_ProcessControlRequest(&SteelBattalion_HID_Interface);
+        break;
+#endif
     }
 }
 
-/** Event handler for the USB device Start Of Frame event. */
+/** Event handler for the USB device Start Of Frame event. With INTERRUPT_CONTROL_ENDPOINT this can
+ *  run in the middle of a control request, so the selected endpoint is put back afterwards. */
 void EVENT_USB_Device_StartOfFrame(void)
 {
+    uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+    ReadOutEndpoint();
+    Endpoint_SelectEndpoint(prevEndpoint);
+
     switch (ConnectedXID)
     {
     case DUKE_CONTROLLER:
         HID_Device_MillisecondElapsed(&DukeController_HID_Interface);
+#if defined(ENABLE_SOF_REPORTS) || defined(ENABLE_LATENCY_STATS)
+        DukeINStartOfFrame();
+#endif
         break;
-
+#ifdef SUPPORTBATTALION
+    case STEELBATTALION:
+        HID_Device_MillisecondElapsed(&SteelBattalion_HID_Interface);
+        break;
+#endif
     }
 }
 
@@ -192,28 +350,20 @@ bool CALLBACK_HID_Device_CreateHIDReport(USB_ClassInfo_HID_Device_t *const HIDIn
     switch (ConnectedXID)
     {
     case DUKE_CONTROLLER:
-        DukeReport->startByte = 0x00;
-        DukeReport->bLength = 20;
-        DukeReport->dButtons = XboxOGDuke.dButtons;
+        DukeCopyInput(DukeReport);
         DukeReport->reserved = 0x00;
-        DukeReport->A = XboxOGDuke.A;
-        DukeReport->B = XboxOGDuke.B;
-        DukeReport->X = XboxOGDuke.X;
-        DukeReport->Y = XboxOGDuke.Y;
-        DukeReport->BLACK = XboxOGDuke.BLACK;
-        DukeReport->WHITE = XboxOGDuke.WHITE;
-        DukeReport->L = XboxOGDuke.L;
-        DukeReport->R = XboxOGDuke.R;
-        DukeReport->leftStickX = XboxOGDuke.leftStickX;
-        DukeReport->leftStickY = XboxOGDuke.leftStickY;
-        DukeReport->rightStickX = XboxOGDuke.rightStickX;
-        DukeReport->rightStickY = XboxOGDuke.rightStickY;
         *ReportSize = DukeReport->bLength;
         break;
-
+#ifdef SUPPORTBATTALION
+    case STEELBATTALION:
+        BattalionCopyInput(BattalionReport);
+        *ReportSize = BATTALION_REPORT_SIZE;
+        break;
+#endif
     }
 
-    return false;
+    //Always send, the caller has already checked there is something new
+    return true;
 }
 
 /* HID class driver callback for the user processing of a received HID OUT report. This callback may fire in response to
@@ -229,9 +379,7 @@ void CALLBACK_HID_Device_ProcessHIDReport(
     //See http://euc.jp/periphs/xbox-controller.en.html - Output Report
     if (ConnectedXID == DUKE_CONTROLLER && ReportSize == 0x06)
     {
-        XboxOGDuke.left_actuator = ((uint8_t *)ReportData)[3];
-        XboxOGDuke.right_actuator = ((uint8_t *)ReportData)[5];
-        XboxOGDuke.rumbleUpdate = 1;
+        DukeWriteRumble(((uint8_t *)ReportData)[3], ((uint8_t *)ReportData)[5]);
     }
 }
 
@@ -247,28 +395,16 @@ uint16_t CALLBACK_USB_GetDescriptor(
     const void *Address = NULL;
     uint16_t Size = NO_DESCRIPTOR;
 
+    const XidPersonality_t *personality = &XID_PERSONALITIES[XidPersonality];
     switch (DescriptorType)
     {
     case DTYPE_Device:
-        switch (ConnectedXID)
-        {
-        case DUKE_CONTROLLER:
-            Address = &DUKE_USB_DESCRIPTOR_DEVICE;
-            Size = 18;
-            break;
-
-        }
+        Address = XidDescriptor(&personality->device);
+        Size = pgm_read_byte(Address); //bLength
         break;
     case DTYPE_Configuration:
-
-        switch (ConnectedXID)
-        {
-        case DUKE_CONTROLLER:
-            Address = &DUKE_USB_DESCRIPTOR_CONFIGURATION;
-            Size = 32;
-            break;
-
-        }
+        Address = XidDescriptor(&personality->configuration);
+        Size = pgm_read_word((const uint8_t *)Address + 2); //wTotalLength
         break;
     case DTYPE_String:
         Address = &nullString; //OG Xbox controller doesn't use these.
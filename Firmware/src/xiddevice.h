@@ -43,10 +43,22 @@ this software.
 #include <LUFA/Drivers/USB/USB.h>
 #include "dukecontroller.h"
 #include "steelbattalion.h"
+#include "xiddriver.h"
 
 #define DUKE_CONTROLLER 0
 #define STEELBATTALION 1
 
+//XID devices the adapter can present itself as, see XID_PERSONALITIES[] in xiddevice.c
+#define XID_DUKE 0
+#define XID_CONTROLLER_S 1
+#ifdef SUPPORTBATTALION
+#define XID_STEELBATTALION 2
+#define XID_PERSONALITY_COUNT 3
+#else
+#define XID_PERSONALITY_COUNT 2
+#endif
+#define XID_DETACH_MS 100 //How long to stay detached when switching, so the console sees the device unplugged
+
 /* Function Prototypes: */
 #ifdef __cplusplus
 extern "C"
@@ -59,6 +71,7 @@ extern "C"
         ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG(3);
     void SetupHardware(void);
     void EVENT_USB_Device_Connect(void);
+    void EVENT_USB_Device_Reset(void);
     void EVENT_USB_Device_Disconnect(void);
     void EVENT_USB_Device_ConfigurationChanged(void);
     void EVENT_USB_Device_ControlRequest(void);
@@ -77,8 +90,13 @@ extern "C"
     /* Data Types: */
     extern USB_ClassInfo_HID_Device_t DukeController_HID_Interface;
     extern USB_ClassInfo_HID_Device_t SteelBattalion_HID_Interface;
+    bool DukeReadRumble(uint8_t *left, uint8_t *right, uint8_t *seen);
+    void XidSetPersonality(uint8_t personality);
+
+    extern volatile uint8_t XidPersonality;
+
     extern USB_XboxGamepad_Data_t XboxOGDuke;
-    extern bool enumerationComplete;
+    extern volatile bool enumerationComplete;
     extern uint8_t playerID;
 #ifdef __cplusplus
 }
@@ -0,0 +1,262 @@
+/*
+ * xiddriver.c
+ *
+ * The Duke IN report path, see xiddriver.h.
+ *
+ * The IN endpoint has two banks, but at most one holds a report the console has
+ * not read yet. A newer report replaces that one instead of queueing behind it,
+ * so the console always reads the freshest input, and the second bank takes the
+ * new report while the old one may still be going out.
+ */
+
+#include "settings.h"
+#include "xiddriver.h"
+#include <string.h>
+#include <util/atomic.h>
+
+//The report layout is fixed, check the struct still matches it
+_Static_assert(DUKE_INPUT_OFFSET == 2, "Duke input must follow startByte and bLength");
+_Static_assert(DUKE_INPUT_OFFSET + DUKE_INPUT_SIZE == DUKE_REPORT_SIZE, "Duke report must be 20 bytes");
+_Static_assert(DUKE_INPUT_SIZE == 18, "DukeWriteReport() writes 18 input bytes");
+
+#ifdef SUPPORTBATTALION
+_Static_assert(sizeof(USB_XboxSteelBattalion_Data_t) == BATTALION_REPORT_SIZE, "Steel Battalion report must be 26 bytes");
+#endif
+
+extern USB_ClassInfo_HID_Device_t DukeController_HID_Interface;
+
+//Input: the main loop fills the back buffer and then flips DukeInputFront, a single byte store.
+//Readers use the front buffer, so they always see one whole report.
+static uint8_t DukeInputBuffer[2][DUKE_INPUT_SIZE];
+static volatile uint8_t DukeInputFront = 0;
+static volatile bool DukeInputFresh = false; //Input was published since the last report was loaded
+static uint16_t DukeInputFrame[2];           //Frame each input buffer was published in
+
+static bool DukeINPending = false; //A loaded report is waiting for the console
+static uint16_t DukeINSampleFrame; //Frame the input of the pending report was published in
+static uint16_t DukeINReadFrame;   //Frame the console was last seen to have read a report
+#ifdef ENABLE_LATENCY_STATS
+static DukeINStats_t DukeINStats;
+#endif
+
+/** Write a whole report into the selected endpoint bank, one store per byte. */
+static inline void DukeWriteReport(const uint8_t *input) ATTR_ALWAYS_INLINE;
+static inline void DukeWriteReport(const uint8_t *input)
+{
+    Endpoint_Write_8(0x00); //startByte
+    Endpoint_Write_8(DUKE_REPORT_SIZE);
+    Endpoint_Write_8(input[0]);
+    Endpoint_Write_8(input[1]);
+    Endpoint_Write_8(input[2]);
+    Endpoint_Write_8(input[3]);
+    Endpoint_Write_8(input[4]);
+    Endpoint_Write_8(input[5]);
+    Endpoint_Write_8(input[6]);
+    Endpoint_Write_8(input[7]);
+    Endpoint_Write_8(input[8]);
+    Endpoint_Write_8(input[9]);
+    Endpoint_Write_8(input[10]);
+    Endpoint_Write_8(input[11]);
+    Endpoint_Write_8(input[12]);
+    Endpoint_Write_8(input[13]);
+    Endpoint_Write_8(input[14]);
+    Endpoint_Write_8(input[15]);
+    Endpoint_Write_8(input[16]);
+    Endpoint_Write_8(input[17]);
+}
+
+/** Kill the last bank written to the selected IN endpoint. If the console is reading that bank
+ *  right now it goes out anyway, and the kill finishes when it has. Returns false if it hasn't
+ *  finished after XID_KILLBK_SPINS polls, in which case the bank may still be busy. */
+static bool XidKillLastBank(void)
+{
+    //The other UEINTX flags are cleared by writing 0 and ignore a 1, so write ones rather than
+    //read-modify-write, which would clear a flag set between the read and the write
+    UEINTX = 0xFF;
+    for (uint8_t spins = XID_KILLBK_SPINS; spins; spins--)
+    {
+        if (!(UEINTX & (1 << KILLBK)))
+            return true;
+    }
+    return false;
+}
+
+/** Note if the console has read the pending report. The IN endpoint must be selected and interrupts disabled. */
+static void DukeCheckINRead(uint16_t frame)
+{
+    if (!DukeINPending || Endpoint_GetBusyBanks() != 0)
+        return;
+    DukeINPending = false;
+    DukeINReadFrame = frame;
+#ifdef ENABLE_LATENCY_STATS
+    uint16_t age = (frame - DukeINSampleFrame) & 0x7FF; //Frame numbers are 11 bits
+    if (age >= DUKE_LATENCY_BUCKETS)
+        age = DUKE_LATENCY_BUCKETS - 1;
+    if (DukeINStats.age[age] != 0xFFFF)
+        DukeINStats.age[age]++;
+#endif
+}
+
+/** Load the latest published input into the IN endpoint, replacing a report still waiting there.
+ *  The IN endpoint must be selected and interrupts disabled. Returns false if no bank was free. */
+static bool DukeLoadIN(uint16_t frame)
+{
+    DukeCheckINRead(frame);
+    if (DukeINPending)
+    {
+        //Try again on the next call rather than wait here with interrupts off
+        if (!XidKillLastBank())
+            return false;
+#ifdef ENABLE_LATENCY_STATS
+        if (DukeINStats.replaced != 0xFFFF)
+            DukeINStats.replaced++;
+#endif
+    }
+    if (!Endpoint_IsReadWriteAllowed())
+        return false;
+
+    uint8_t front = DukeInputFront;
+    DukeWriteReport(DukeInputBuffer[front]);
+    Endpoint_ClearIN();
+
+    DukeINPending = true;
+    DukeINSampleFrame = DukeInputFrame[front];
+    DukeInputFresh = false;
+
+    //The bookkeeping HID_Device_USBTask() would do
+    DukeController_HID_Interface.State.PrevFrameNum = frame;
+    DukeController_HID_Interface.State.IdleMSRemaining = DukeController_HID_Interface.State.IdleCount;
+    return true;
+}
+
+/** Publish the input part of a Duke report to be sent. Main loop only. */
+void DukePublishInput(const USB_XboxGamepad_Data_t *report)
+{
+    uint8_t back = DukeInputFront ^ 1;
+    memcpy(DukeInputBuffer[back], &report->dButtons, DUKE_INPUT_SIZE);
+    DukeInputFrame[back] = USB_Device_GetFrameNumber();
+    DukeInputFront = back;
+    DukeInputFresh = true;
+}
+
+/** Copy the last published input into a report, for GET_REPORT. */
+void DukeCopyInput(USB_XboxGamepad_Data_t *report)
+{
+    report->startByte = 0x00;
+    report->bLength = DUKE_REPORT_SIZE;
+    memcpy(&report->dButtons, DukeInputBuffer[DukeInputFront], DUKE_INPUT_SIZE);
+}
+
+/** Load the latest published input into the IN endpoint from the main loop, replacing a report
+ *  the console has not read yet. Returns false if it could not be loaded. */
+bool DukeSendReport(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return false;
+
+    bool sent;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+        Endpoint_SelectEndpoint(DUKE_IN_ENDPOINT);
+        uint16_t frame = USB_Device_GetFrameNumber();
+        sent = DukeLoadIN(frame);
+        Endpoint_SelectEndpoint(prevEndpoint);
+    }
+    return sent;
+}
+
+/** Forget any loaded report, called when the endpoint is configured. */
+void DukeINReset(void)
+{
+    DukeINPending = false;
+}
+
+/** Called from the SOF interrupt. Tracks when the console reads the IN endpoint and, with
+ *  ENABLE_SOF_REPORTS, loads the latest published report once the console is about to poll
+ *  again, so it reads input that is under a frame old whatever the main loop is doing. */
+void DukeINStartOfFrame(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+    Endpoint_SelectEndpoint(DUKE_IN_ENDPOINT);
+    uint16_t frame = USB_Device_GetFrameNumber();
+    DukeCheckINRead(frame);
+#ifdef ENABLE_SOF_REPORTS
+    //The next poll is DUKE_POLL_INTERVAL_MS frames after the last read. A report is only loaded
+    //then if there is new input, or to repeat the last one once the SET_IDLE period is up,
+    //the same rules as xidReportDue() in main.cpp
+    const USB_ClassInfo_HID_Device_State_t *state = &DukeController_HID_Interface.State;
+    bool idleElapsed = !DukeINPending && state->IdleCount && !state->IdleMSRemaining;
+    if (((frame - DukeINReadFrame) & 0x7FF) >= DUKE_POLL_INTERVAL_MS - 1 && (DukeInputFresh || idleElapsed))
+        DukeLoadIN(frame);
+#endif
+    Endpoint_SelectEndpoint(prevEndpoint);
+}
+
+#ifdef ENABLE_LATENCY_STATS
+/** Copy the IN report statistics, see DukeINStats_t. */
+void DukeReadINStats(DukeINStats_t *stats)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *stats = DukeINStats;
+    }
+}
+#endif
+
+#ifdef SUPPORTBATTALION
+extern USB_ClassInfo_HID_Device_t SteelBattalion_HID_Interface;
+
+//Published like the Duke input, the main loop fills the back buffer and flips the front
+static uint8_t BattalionInputBuffer[2][BATTALION_INPUT_SIZE];
+static volatile uint8_t BattalionInputFront = 0;
+
+/** Publish the input part of a Steel Battalion report to be sent. Main loop only. */
+void BattalionPublishInput(const USB_XboxSteelBattalion_Data_t *report)
+{
+    uint8_t back = BattalionInputFront ^ 1;
+    memcpy(BattalionInputBuffer[back], &report->dButtons, BATTALION_INPUT_SIZE);
+    BattalionInputFront = back;
+}
+
+/** Copy the last published input into a report, for GET_REPORT. */
+void BattalionCopyInput(USB_XboxSteelBattalion_Data_t *report)
+{
+    report->startByte = 0x00;
+    report->bLength = BATTALION_REPORT_SIZE;
+    memcpy(&report->dButtons, BattalionInputBuffer[BattalionInputFront], BATTALION_INPUT_SIZE);
+}
+
+/** Load the latest published input into the IN endpoint, replacing a report the console has
+ *  not read yet, the same policy as the Duke. Returns false if it could not be loaded. */
+bool BattalionSendReport(void)
+{
+    if (USB_DeviceState != DEVICE_STATE_Configured)
+        return false;
+
+    bool sent = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t prevEndpoint = Endpoint_GetCurrentEndpoint();
+        Endpoint_SelectEndpoint(BATTALION_IN_ENDPOINT);
+        if ((Endpoint_GetBusyBanks() == 0 || XidKillLastBank()) && Endpoint_IsReadWriteAllowed())
+        {
+            const uint8_t *input = BattalionInputBuffer[BattalionInputFront];
+            Endpoint_Write_8(0x00); //startByte
+            Endpoint_Write_8(BATTALION_REPORT_SIZE);
+            for (uint8_t i = 0; i < BATTALION_INPUT_SIZE; i++)
+                Endpoint_Write_8(input[i]);
+            Endpoint_ClearIN();
+
+            SteelBattalion_HID_Interface.State.PrevFrameNum = USB_Device_GetFrameNumber();
+            SteelBattalion_HID_Interface.State.IdleMSRemaining = SteelBattalion_HID_Interface.State.IdleCount;
+            sent = true;
+        }
+        Endpoint_SelectEndpoint(prevEndpoint);
+    }
+    return sent;
+}
+#endif
@@ -0,0 +1,119 @@
+/*
+ * xiddriver.h
+ *
+ * The Duke IN report path. Every Duke report is the same 20 bytes, so
+ * rather than going through LUFA's generic HID_Device_USBTask() (a VLA,
+ * memset, callback, memcmp/memcpy and a stream write loop per report) the
+ * report is written into the endpoint straight from the published input
+ * with one unrolled store per byte. xiddevice.c still owns the descriptors,
+ * control requests and rumble.
+ *
+ * The Steel Battalion report has a simpler path of its own, it is only sent
+ * from the main loop and keeps no statistics.
+ */
+
+#ifndef XIDDRIVER_H_
+#define XIDDRIVER_H_
+#include <stddef.h>
+#include <LUFAConfig.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include "settings.h"
+
+//The Duke IN report. The part the console sees is the first DUKE_REPORT_SIZE bytes
+typedef struct
+{
+    uint8_t startByte; //Always 0x00
+    uint8_t bLength;
+    uint8_t dButtons;
+    uint8_t reserved;
+    uint8_t A;
+    uint8_t B;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t BLACK;
+    uint8_t WHITE;
+    uint8_t L;
+    uint8_t R;
+    int16_t leftStickX;
+    int16_t leftStickY;
+    int16_t rightStickX;
+    int16_t rightStickY;
+    //These last few values aren't part of the xbox controller HID report, but are added here by me to store extra stuff.
+    uint8_t left_actuator;
+    uint8_t right_actuator;
+    uint8_t rumbleUpdate;
+} USB_XboxGamepad_Data_t;
+
+#define DUKE_IN_ENDPOINT 0x81
+#define DUKE_REPORT_SIZE 20
+
+//The input part of the Duke report, dButtons to rightStickY
+#define DUKE_INPUT_OFFSET offsetof(USB_XboxGamepad_Data_t, dButtons)
+#define DUKE_INPUT_SIZE (offsetof(USB_XboxGamepad_Data_t, left_actuator) - DUKE_INPUT_OFFSET)
+
+#ifndef KILLBK
+#define KILLBK RXOUTI //The same UEINTX bit. On an IN endpoint it kills the last written bank
+#endif
+#define XID_KILLBK_SPINS 128 //Polls for a bank kill to finish, about 50us. A 20 byte IN transaction takes about 20us
+
+#ifdef ENABLE_LATENCY_STATS
+#define DUKE_LATENCY_BUCKETS 8
+typedef struct
+{
+    uint16_t age[DUKE_LATENCY_BUCKETS]; //Reports read by the console, by frames from publishing to the read. The last bucket counts all older ones
+    uint16_t replaced;                  //Reports replaced by newer input before the console read them
+} DukeINStats_t;
+#endif
+
+#ifdef SUPPORTBATTALION
+//The Steel Battalion IN report, see steelbattalion.h for the button masks
+typedef struct
+{
+    uint8_t startByte; //Always 0x00
+    uint8_t bLength;
+    uint16_t dButtons[3];
+    uint16_t aimingX; //0x0000 is left and up, 0x8000 centred
+    uint16_t aimingY;
+    int16_t rotationLever;
+    int16_t sightChangeX;
+    int16_t sightChangeY;
+    uint16_t leftPedal;
+    uint16_t middlePedal;
+    uint16_t rightPedal;
+    int8_t tunerDial;
+    int8_t gearLever;
+} USB_XboxSteelBattalion_Data_t;
+
+#define BATTALION_IN_ENDPOINT 0x82
+#define BATTALION_OUT_ENDPOINT 0x01
+#define BATTALION_ENDPOINT_SIZE 32
+#define BATTALION_REPORT_SIZE 26
+#define BATTALION_POLL_INTERVAL_MS 4 //bInterval of the Battalion endpoints
+
+#define BATTALION_INPUT_OFFSET offsetof(USB_XboxSteelBattalion_Data_t, dButtons)
+#define BATTALION_INPUT_SIZE (BATTALION_REPORT_SIZE - BATTALION_INPUT_OFFSET)
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    void DukePublishInput(const USB_XboxGamepad_Data_t *report);
+    void DukeCopyInput(USB_XboxGamepad_Data_t *report);
+    bool DukeSendReport(void);
+    void DukeINReset(void);
+    void DukeINStartOfFrame(void);
+#ifdef ENABLE_LATENCY_STATS
+    void DukeReadINStats(DukeINStats_t *stats);
+#endif
+#ifdef SUPPORTBATTALION
+    void BattalionPublishInput(const USB_XboxSteelBattalion_Data_t *report);
+    void BattalionCopyInput(USB_XboxSteelBattalion_Data_t *report);
+    bool BattalionSendReport(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* XIDDRIVER_H_ */
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Read the ogx360 performance counters over USB.
+
+Plug the MASTER module into a PC instead of a console and run
+    python3 telemetry.py            print the counters once
+    python3 telemetry.py -w 5       print them every 5 seconds, counts as rates
+
+Needs pyusb (pip install pyusb) and permission to open the device, on Linux
+run as root or add a udev rule for 045e:0289. The block layout is
+TelemetryBlock_t in src/telemetry.h.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import usb.core
+
+TELEMETRY_REQUEST = 0x54
+TELEMETRY_VERSION = 1
+REQUEST_TYPE = 0xC0  # Vendor, device to host, device
+
+RUN_BUCKETS = 8
+MAX_TASKS = 6
+AGE_BUCKETS = 8
+
+# uptime, runTimes, taskCount, tasks, host counters, reportAge, replaced, enumeration times
+BLOCK = struct.Struct("<BBI%dIB%dH3I%dHHHH" % (RUN_BUCKETS, MAX_TASKS * 3, AGE_BUCKETS))
+
+# The order of TASKS[] in main.cpp
+TASK_NAMES = ["report", "input", "usb host", "commands", "attach", "oled"]
+RUN_LABELS = ["<64us", "<128us", "<256us", "<512us", "<1ms", "<2ms", "<4ms", ">=4ms"]
+AGE_LABELS = ["0", "1", "2", "3", "4", "5", "6", ">=7"]
+
+
+def read_block(dev):
+    data = bytes(dev.ctrl_transfer(REQUEST_TYPE, TELEMETRY_REQUEST, 0, 0, 256))
+    if len(data) < 2 or data[0] != TELEMETRY_VERSION:
+        sys.exit("Unsupported telemetry version %d, this tool reads version %d" % (data[0] if data else -1, TELEMETRY_VERSION))
+    if len(data) != BLOCK.size or data[1] != BLOCK.size:
+        sys.exit("Telemetry block is %d bytes, expected %d" % (len(data), BLOCK.size))
+
+    v = list(BLOCK.unpack(data))
+    block = {}
+    block["uptime"] = v[2]
+    block["runTimes"] = v[3:3 + RUN_BUCKETS]
+    i = 3 + RUN_BUCKETS
+    block["taskCount"] = v[i]
+    i += 1
+    block["tasks"] = [tuple(v[i + t * 3:i + t * 3 + 3]) for t in range(MAX_TASKS)]
+    i += MAX_TASKS * 3
+    block["hostNaks"], block["hostTimeouts"], block["hostErrors"] = v[i:i + 3]
+    i += 3
+    block["reportAge"] = v[i:i + AGE_BUCKETS]
+    i += AGE_BUCKETS
+    block["reportsReplaced"], block["deviceEnumTime"], block["hostEnumTime"] = v[i:i + 3]
+    return block
+
+
+COUNT_MAX = 0xFFFF  # Where the 16-bit counts stop
+
+
+def delta(now, before, bits=32):
+    return (now - before) % (1 << bits)
+
+
+def count(now, before):
+    """A 16-bit count since the last read, or in total. These stop at COUNT_MAX rather than wrap."""
+    return now - before if before is not None else now
+
+
+def stuck(counts):
+    return " (stopped at %d, no longer counting)" % COUNT_MAX if COUNT_MAX in counts else ""
+
+
+def histogram(labels, counts):
+    total = sum(counts)
+    for label, count in zip(labels, counts):
+        share = 100.0 * count / total if total else 0.0
+        print("  %-7s %10d %5.1f%% %s" % (label, count, share, "#" * int(share / 2)))
+
+
+def show(block, previous):
+    print("Uptime %.1f s" % (block["uptime"] / 1000.0))
+    if previous:
+        seconds = delta(block["uptime"], previous["uptime"]) / 1000.0
+        print("Counts over the last %.1f s" % seconds)
+
+    print("Task run times")
+    runs = block["runTimes"]
+    if previous:
+        runs = [delta(n, b) for n, b in zip(runs, previous["runTimes"])]
+    histogram(RUN_LABELS, runs)
+
+    print("Tasks       overruns   misses  longest")
+    for t in range(min(block["taskCount"], MAX_TASKS)):
+        overruns, misses, longest = block["tasks"][t]
+        before = previous["tasks"][t] if previous else (None, None, None)
+        name = TASK_NAMES[t] if t < len(TASK_NAMES) else "task %d" % t
+        print("  %-9s %8d %8d %6dus%s" % (name, count(overruns, before[0]), count(misses, before[1]), longest,
+                                         stuck((overruns, misses))))
+
+    naks, timeouts, errors = block["hostNaks"], block["hostTimeouts"], block["hostErrors"]
+    if previous:
+        naks = delta(naks, previous["hostNaks"])
+        timeouts = delta(timeouts, previous["hostTimeouts"])
+        errors = delta(errors, previous["hostErrors"])
+    print("USB host: %d NAKs, %d timeouts, %d errors" % (naks, timeouts, errors))
+
+    print("Duke report age when read, in frames%s" % stuck(block["reportAge"]))
+    ages = block["reportAge"]
+    if previous:
+        ages = [count(n, b) for n, b in zip(ages, previous["reportAge"])]
+    histogram(AGE_LABELS, ages)
+    replaced = block["reportsReplaced"]
+    print("  %d replaced before being read%s" % (count(replaced, previous["reportsReplaced"] if previous else None),
+                                                stuck((replaced,))))
+
+    print("Enumeration: console/PC %d ms, controller %d ms" % (block["deviceEnumTime"], block["hostEnumTime"]))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--vid", type=lambda s: int(s, 16), default=0x045E, help="USB vendor ID, hex")
+    parser.add_argument("--pid", type=lambda s: int(s, 16), default=0x0289, help="USB product ID, hex")
+    parser.add_argument("-w", "--watch", type=float, metavar="SECONDS", help="read again every SECONDS")
+    args = parser.parse_args()
+
+    dev = usb.core.find(idVendor=args.vid, idProduct=args.pid)
+    if dev is None:
+        sys.exit("No device %04x:%04x found" % (args.vid, args.pid))
+
+    previous = None
+    while True:
+        block = read_block(dev)
+        if previous and block["uptime"] < previous["uptime"]:
+            previous = None  # Restarted, the counts started again from zero
+        show(block, previous)
+        if not args.watch:
+            break
+        previous = block
+        time.sleep(args.watch)
+
+
+if __name__ == "__main__":
+    main()